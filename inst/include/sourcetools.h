@@ -8,7 +8,9 @@
 #include <sourcetools/cursor/cursor.h>
 #include <sourcetools/r/r.h>
 #include <sourcetools/read/read.h>
+#include <sourcetools/cache/cache.h>
 #include <sourcetools/parse/parse.h>
+#include <sourcetools/serialize/serialize.h>
 #include <sourcetools/diagnostics/diagnostics.h>
 #include <sourcetools/tokenization/tokenization.h>
 #include <sourcetools/validation/validation.h>
@@ -0,0 +1,413 @@
+#ifndef SOURCETOOLS_CACHE_DISK_CACHE_H
+#define SOURCETOOLS_CACHE_DISK_CACHE_H
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifndef _WIN32
+# include <unistd.h>
+#else
+# include <process.h>
+#endif
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/read/read.h>
+#include <sourcetools/r/RHeaders.h>
+
+namespace sourcetools {
+namespace cache {
+
+// The contents of a cache entry: columns of integers, and strings.
+struct Entry
+{
+  std::vector< std::vector<int> > columns;
+  std::vector<std::string> strings;
+};
+
+// Results stored in a directory, keyed by the hash of the contents they
+// were computed from. Entries are written to a temporary file and then
+// renamed, so that processes sharing a directory never see a partial
+// entry, and are memory mapped when read back. Entries written by other
+// versions of sourcetools, or on machines with a different byte order,
+// are ignored.
+//
+// Each file hashed is also given a stamp, recording its size and
+// modification time along with the hash of its contents. As long as
+// those still match, the file need not be read to find its hash.
+class DiskCache : noncopyable
+{
+public:
+
+  DiskCache(const std::string& directory, const std::string& version)
+    : directory_(directory), version_(version), counter_(0)
+  {
+  }
+
+  // A key for results of the given kind, computed from 'value' (e.g. the
+  // hash of a file's contents).
+  hash_type key(const std::string& kind, hash_type value) const
+  {
+    hash_type result = hash::update(hash::initial(), version_);
+    result = hash::update(result, kind);
+    return hash::update(result, value);
+  }
+
+  // Find the hash of the contents of a file. When 'pContents' is given,
+  // the file is always read, and hashed from what was read; otherwise,
+  // the hash is taken from the file's stamp when it is still valid.
+  bool hashFile(const std::string& path, hash_type* pHash, std::string* pContents = NULL)
+  {
+    FileInfo info;
+    if (!stat(path, &info))
+      return false;
+
+    std::string stampPath = file(hash::compute(path), "stamp");
+    if (pContents == NULL)
+    {
+      Entry stamp;
+      if (read(stampPath, &stamp) && valid(stamp, path, info))
+      {
+        *pHash = join(stamp.columns[0], 6);
+        return true;
+      }
+    }
+
+    std::string contents;
+    if (!sourcetools::read(path, &contents))
+      return false;
+
+    *pHash = hash::compute(contents);
+
+    // A file modified within the same second as its stamp was written
+    // could keep its size and modification time, so stamps are only
+    // trusted for files last modified before they were written; see
+    // 'valid()'.
+    Entry stamp;
+    stamp.columns.resize(1);
+    split(static_cast<hash_type>(contents.size()), &stamp.columns[0]);
+    split(static_cast<hash_type>(info.mtime), &stamp.columns[0]);
+    split(static_cast<hash_type>(std::time(NULL)), &stamp.columns[0]);
+    split(*pHash, &stamp.columns[0]);
+    stamp.strings.push_back(path);
+    write(stampPath, stamp);
+
+    if (pContents != NULL)
+      pContents->swap(contents);
+
+    return true;
+  }
+
+  bool read(hash_type key, Entry* pEntry) const
+  {
+    return read(file(key, "entry"), pEntry);
+  }
+
+  bool write(hash_type key, const Entry& entry)
+  {
+    return write(file(key, "entry"), entry);
+  }
+
+  // Results may also be stored in a format of their own (e.g. serialized
+  // parse trees), as the file at 'path(key)'. The key already covers the
+  // sourcetools version, but the format must still check that what it
+  // reads back is well formed.
+  std::string path(hash_type key) const
+  {
+    return file(key, "data");
+  }
+
+  bool write(hash_type key, const std::string& data)
+  {
+    return writeFile(path(key), data);
+  }
+
+private:
+
+  struct FileInfo
+  {
+    hash_type size;
+    std::time_t mtime;
+  };
+
+  static bool stat(const std::string& path, FileInfo* pInfo)
+  {
+    struct stat info;
+    if (::stat(path.c_str(), &info) != 0)
+      return false;
+
+    pInfo->size = static_cast<hash_type>(info.st_size);
+    pInfo->mtime = info.st_mtime;
+    return true;
+  }
+
+  static bool valid(const Entry& stamp, const std::string& path, const FileInfo& info)
+  {
+    if (stamp.columns.size() != 1 || stamp.columns[0].size() != 8)
+      return false;
+
+    if (stamp.strings.size() != 1 || stamp.strings[0] != path)
+      return false;
+
+    const std::vector<int>& fields = stamp.columns[0];
+    hash_type written = join(fields, 4);
+    return join(fields, 0) == info.size &&
+           join(fields, 2) == static_cast<hash_type>(info.mtime) &&
+           static_cast<hash_type>(info.mtime) < written;
+  }
+
+  std::string file(hash_type key, const char* extension) const
+  {
+    static const char* digits = "0123456789abcdef";
+
+    std::string name(16, '0');
+    for (index_type i = 15; i >= 0; --i, key >>= 4)
+      name[i] = digits[key & 0xf];
+
+    return directory_ + "/" + name + "." + extension;
+  }
+
+  // 64-bit values are stored as two 32-bit integers, low word first.
+  static void split(hash_type value, std::vector<int>* pFields)
+  {
+    pFields->push_back(static_cast<int>(static_cast<uint32_t>(value)));
+    pFields->push_back(static_cast<int>(static_cast<uint32_t>(value >> 32)));
+  }
+
+  static hash_type join(const std::vector<int>& fields, index_type i)
+  {
+    hash_type low = static_cast<uint32_t>(fields[i]);
+    hash_type high = static_cast<uint32_t>(fields[i + 1]);
+    return low | (high << 32);
+  }
+
+  // The layout of an entry file is:
+  //
+  //    magic            "SRCTOOLS"
+  //    format           int
+  //    byte order       int (0x01020304, as written)
+  //    version          int length, then bytes
+  //    columns          int count; for each, int length, then ints
+  //    strings          int count; for each, int length, then bytes
+  //
+  // with integers in the byte order of the machine writing the entry.
+  static const char* magic() { return "SRCTOOLS"; }
+  static int format() { return 1; }
+  static int byteOrder() { return 0x01020304; }
+
+  class Reader
+  {
+  public:
+
+    Reader(const char* begin, const char* end)
+      : pos_(begin), end_(end)
+    {
+    }
+
+    bool read(int* pValue)
+    {
+      if (end_ - pos_ < static_cast<std::ptrdiff_t>(sizeof(int)))
+        return false;
+
+      std::memcpy(pValue, pos_, sizeof(int));
+      pos_ += sizeof(int);
+      return true;
+    }
+
+    bool read(std::string* pValue)
+    {
+      int n;
+      if (!read(&n) || n < 0 || end_ - pos_ < n)
+        return false;
+
+      pValue->assign(pos_, n);
+      pos_ += n;
+      return true;
+    }
+
+    bool read(std::vector<int>* pValue)
+    {
+      int n;
+      if (!read(&n) || n < 0 || (end_ - pos_) / static_cast<std::ptrdiff_t>(sizeof(int)) < n)
+        return false;
+
+      pValue->resize(n);
+      if (n > 0)
+        std::memcpy(&(*pValue)[0], pos_, n * sizeof(int));
+      pos_ += n * sizeof(int);
+      return true;
+    }
+
+    bool done() const
+    {
+      return pos_ == end_;
+    }
+
+  private:
+    const char* pos_;
+    const char* end_;
+  };
+
+  static void append(int value, std::string* pBuffer)
+  {
+    pBuffer->append(reinterpret_cast<const char*>(&value), sizeof(int));
+  }
+
+  static void append(const std::string& value, std::string* pBuffer)
+  {
+    append(utils::size(value), pBuffer);
+    pBuffer->append(value);
+  }
+
+  static void append(const std::vector<int>& value, std::string* pBuffer)
+  {
+    append(utils::size(value), pBuffer);
+    if (!value.empty())
+      pBuffer->append(reinterpret_cast<const char*>(&value[0]), value.size() * sizeof(int));
+  }
+
+  bool read(const std::string& path, Entry* pEntry) const
+  {
+    detail::FileConnection conn(path.c_str());
+    if (!conn.open())
+      return false;
+
+    std::size_t size;
+    if (!conn.size(&size) || size < std::strlen(magic()))
+      return false;
+
+    detail::MemoryMappedConnection map(conn, size, false);
+    if (!map.open())
+      return false;
+
+    const char* data = map;
+    std::size_t n = std::strlen(magic());
+    if (std::memcmp(data, magic(), n) != 0)
+      return false;
+
+    Reader reader(data + n, data + size);
+
+    int value;
+    if (!reader.read(&value) || value != format())
+      return false;
+    if (!reader.read(&value) || value != byteOrder())
+      return false;
+
+    std::string version;
+    if (!reader.read(&version) || version != version_)
+      return false;
+
+    Entry entry;
+    int count;
+    if (!reader.read(&count) || count < 0)
+      return false;
+    entry.columns.resize(count);
+    for (int i = 0; i < count; ++i)
+      if (!reader.read(&entry.columns[i]))
+        return false;
+
+    if (!reader.read(&count) || count < 0)
+      return false;
+    entry.strings.resize(count);
+    for (int i = 0; i < count; ++i)
+      if (!reader.read(&entry.strings[i]))
+        return false;
+
+    if (!reader.done())
+      return false;
+
+    std::swap(*pEntry, entry);
+    return true;
+  }
+
+  bool write(const std::string& path, const Entry& entry)
+  {
+    std::string buffer(magic());
+    append(format(), &buffer);
+    append(byteOrder(), &buffer);
+    append(version_, &buffer);
+
+    append(utils::size(entry.columns), &buffer);
+    for (index_type i = 0; i < utils::size(entry.columns); ++i)
+      append(entry.columns[i], &buffer);
+
+    append(utils::size(entry.strings), &buffer);
+    for (index_type i = 0; i < utils::size(entry.strings); ++i)
+      append(entry.strings[i], &buffer);
+
+    return writeFile(path, buffer);
+  }
+
+  bool writeFile(const std::string& path, const std::string& buffer)
+  {
+    std::string temporary = temporaryFile(path);
+    {
+      std::ofstream output(temporary.c_str(), std::ios::out | std::ios::binary);
+      output.write(buffer.data(), buffer.size());
+      output.close();
+      if (output.fail())
+      {
+        std::remove(temporary.c_str());
+        return false;
+      }
+    }
+
+    // Renaming over an existing file fails on Windows; the entry there
+    // may be in use by another process, in which case ours is dropped.
+    if (std::rename(temporary.c_str(), path.c_str()) != 0)
+    {
+      std::remove(path.c_str());
+      if (std::rename(temporary.c_str(), path.c_str()) != 0)
+      {
+        std::remove(temporary.c_str());
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  std::string temporaryFile(const std::string& path)
+  {
+#ifndef _WIN32
+    long pid = static_cast<long>(::getpid());
+#else
+    long pid = static_cast<long>(::_getpid());
+#endif
+
+    char suffix[64];
+    std::sprintf(suffix, ".%ld.%ld.tmp", pid, static_cast<long>(++counter_));
+    return path + suffix;
+  }
+
+  std::string directory_;
+  std::string version_;
+  index_type counter_;
+};
+
+} // namespace cache
+
+namespace r {
+
+// The cache described by 'cacheSEXP', given from R as the directory and
+// the package version, or NULL when caching is disabled.
+inline cache::DiskCache* createDiskCache(SEXP cacheSEXP)
+{
+  if (TYPEOF(cacheSEXP) != STRSXP || Rf_length(cacheSEXP) != 2)
+    return NULL;
+
+  return new cache::DiskCache(
+    CHAR(STRING_ELT(cacheSEXP, 0)),
+    CHAR(STRING_ELT(cacheSEXP, 1)));
+}
+
+} // namespace r
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_CACHE_DISK_CACHE_H */
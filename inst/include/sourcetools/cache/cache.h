@@ -0,0 +1,6 @@
+#ifndef SOURCETOOLS_CACHE_CACHE_H
+#define SOURCETOOLS_CACHE_CACHE_H
+
+#include <sourcetools/cache/DiskCache.h>
+
+#endif /* SOURCETOOLS_CACHE_CACHE_H */
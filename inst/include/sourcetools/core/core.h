@@ -4,5 +4,6 @@
 #include <sourcetools/core/config.h>
 #include <sourcetools/core/macros.h>
 #include <sourcetools/core/util.h>
+#include <sourcetools/core/hash.h>
 
 #endif /* SOURCETOOLS_CORE_CORE_H */
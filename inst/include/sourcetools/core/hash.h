@@ -0,0 +1,64 @@
+#ifndef SOURCETOOLS_CORE_HASH_H
+#define SOURCETOOLS_CORE_HASH_H
+
+#include <cstddef>
+#include <string>
+
+#include <stdint.h>
+
+namespace sourcetools {
+
+typedef uint64_t hash_type;
+
+// 64-bit FNV-1a. Not cryptographic, but fast, and with few enough
+// collisions to key caches by content.
+namespace hash {
+
+inline hash_type initial()
+{
+  return (static_cast<hash_type>(0xcbf29ce4u) << 32) | 0x84222325u;
+}
+
+inline hash_type update(hash_type hash, const char* data, std::size_t n)
+{
+  static const hash_type prime = (static_cast<hash_type>(1) << 40) | 0x1b3u;
+  for (std::size_t i = 0; i < n; ++i)
+  {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= prime;
+  }
+  return hash;
+}
+
+// Values are hashed a byte at a time, least significant first, so that
+// hashes don't depend on the platform's byte order.
+inline hash_type update(hash_type hash, hash_type value)
+{
+  char bytes[8];
+  for (std::size_t i = 0; i < 8; ++i)
+    bytes[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+  return update(hash, bytes, 8);
+}
+
+// Strings are followed by their length, so that a sequence of strings
+// hashes differently from their concatenation.
+inline hash_type update(hash_type hash, const std::string& value)
+{
+  hash = update(hash, value.data(), value.size());
+  return update(hash, static_cast<hash_type>(value.size()));
+}
+
+inline hash_type compute(const char* data, std::size_t n)
+{
+  return update(initial(), data, n);
+}
+
+inline hash_type compute(const std::string& value)
+{
+  return compute(value.data(), value.size());
+}
+
+} // namespace hash
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_CORE_HASH_H */
@@ -33,6 +33,8 @@ public:
   T& operator*() const { return *pData_; }
   T* operator->() const { return pData_; }
   operator T*() const { return pData_; }
+  T* release() { T* pData = pData_; pData_ = NULL; return pData; }
+  void reset(T* pData = NULL) { if (pData != pData_) { delete pData_; pData_ = pData; } }
   ~scoped_ptr() { delete pData_; }
 private:
   T* pData_;
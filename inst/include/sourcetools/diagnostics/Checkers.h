@@ -2,12 +2,13 @@
 #define SOURCETOOLS_DIAGNOSTICS_CHECKERS_H
 
 #include <vector>
-#include <set>
 #include <string>
 
 #include <sourcetools/r/r.h>
 #include <sourcetools/parse/ParseNode.h>
 #include <sourcetools/diagnostics/Diagnostic.h>
+#include <sourcetools/diagnostics/ScopeAnalysis.h>
+#include <sourcetools/diagnostics/SymbolIndex.h>
 
 namespace sourcetools {
 namespace diagnostics {
@@ -21,6 +22,16 @@ public:
   typedef parser::ParseNode ParseNode;
 
   virtual void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth) = 0;
+
+  // Add the token types of the nodes this checker should be applied to,
+  // so that it is only invoked for those nodes. Checkers that add no
+  // types are applied to every node.
+  virtual void tokenTypes(std::vector<TokenType>* pTypes) const {}
+
+  // Called before a tree is checked, with the scopes resolved for it.
+  // The analysis is only valid until the checks on that tree complete.
+  virtual void prepare(const ScopeAnalysis& scopes) {}
+
   virtual ~CheckerBase() {}
 };
 
@@ -35,6 +46,12 @@ public:
 class ComparisonWithNullChecker : public CheckerBase
 {
 public:
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    pTypes->push_back(tokens::OPERATOR_EQUAL);
+    pTypes->push_back(tokens::OPERATOR_NOT_EQUAL);
+  }
+
   void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
     const Token& token = pNode->token();
@@ -71,6 +88,11 @@ public:
 class AssignmentInIfChecker : public CheckerBase
 {
 public:
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    pTypes->push_back(tokens::KEYWORD_IF);
+  }
+
   void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
     if (!pNode->token().isType(tokens::KEYWORD_IF))
@@ -98,6 +120,11 @@ public:
 class ScalarOpsInIfChecker : public CheckerBase
 {
 public:
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    pTypes->push_back(tokens::KEYWORD_IF);
+  }
+
   void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
     if (!pNode->token().isType(tokens::KEYWORD_IF))
@@ -140,6 +167,26 @@ public:
 class UnusedResultChecker : public CheckerBase
 {
 public:
+  // Only non-assignment operators are reported.
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    using namespace tokens;
+
+    static const TokenType types[] = {
+      OPERATOR_PLUS, OPERATOR_MINUS, OPERATOR_HELP, OPERATOR_NEGATION,
+      OPERATOR_FORMULA, OPERATOR_NAMESPACE_EXPORTS, OPERATOR_NAMESPACE_ALL,
+      OPERATOR_DOLLAR, OPERATOR_AT, OPERATOR_HAT,
+      OPERATOR_EXPONENTATION_STARS, OPERATOR_SEQUENCE, OPERATOR_MULTIPLY,
+      OPERATOR_DIVIDE, OPERATOR_LESS, OPERATOR_LESS_OR_EQUAL,
+      OPERATOR_GREATER, OPERATOR_GREATER_OR_EQUAL, OPERATOR_EQUAL,
+      OPERATOR_NOT_EQUAL, OPERATOR_AND_VECTOR, OPERATOR_AND_SCALAR,
+      OPERATOR_OR_VECTOR, OPERATOR_OR_SCALAR, OPERATOR_USER,
+      OPERATOR_PIPE, OPERATOR_PIPE_BIND
+    };
+
+    pTypes->insert(pTypes->end(), types, types + sizeof(types) / sizeof(types[0]));
+  }
+
   void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
     if (pNode->parent() == NULL)
@@ -179,135 +226,121 @@ class NoSymbolInScopeChecker : public CheckerBase
 public:
 
   NoSymbolInScopeChecker()
+    : pScopes_(NULL),
+      objects_(update(r::searchPathObjects())),
+      pIndex_(NULL)
   {
-    stack_.push_back(Context(0));
-    objects_ = r::objectsOnSearchPath();
   }
 
-  void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
+  // Check against objects that are already up to date. This does not
+  // call into R, so it is safe to use off the main thread. Names in
+  // 'pIndex', when given, are also treated as defined.
+  explicit NoSymbolInScopeChecker(const r::SearchPathObjects& objects,
+                                  const SymbolIndex* pIndex = NULL)
+    : pScopes_(NULL),
+      objects_(objects),
+      pIndex_(pIndex)
   {
-    using namespace tokens;
-    const Token& token = pNode->token();
-
-    // If we've left the last active scope, pop.
-    if (depth < current().depth())
-      pop();
-
-    // Assignments update the current scope.
-    if (token.isType(OPERATOR_ASSIGN_LEFT) ||
-        token.isType(OPERATOR_ASSIGN_LEFT_EQUALS))
-    {
-      const ParseNode* pChild = pNode->children()[0];
-      const Token& symbol = pChild->token();
-      if (symbol.isType(SYMBOL) || symbol.isType(STRING))
-        add(symbol);
-    }
-
-    // Check if a symbol has a definition in scope.
-    if (token.isType(SYMBOL))
-      check(token, pDiagnostics);
+  }
 
-    // If we encounter a function definition, create a new scope
-    // and make the function argument names present in that scope.
-    if (token.isType(KEYWORD_FUNCTION))
-      push(pNode, depth);
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    pTypes->push_back(tokens::SYMBOL);
   }
 
-private:
+  void prepare(const ScopeAnalysis& scopes)
+  {
+    pScopes_ = &scopes;
+  }
 
-  class Context
+  void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
-  public:
-    explicit Context(index_type depth)
-      : depth_(depth)
-    {
-    }
+    index_type index = pScopes_->reference(pNode);
+    if (index == -1)
+      return;
 
-    void add(const Token& token)
-    {
-      values_.insert(token.contents());
-    }
+    const ScopeAnalysis::Reference& reference = pScopes_->references()[index];
+    if (reference.binding != -1)
+      return;
 
-    bool contains(const std::string& contents) const
-    {
-      return values_.count(contents);
-    }
+    const std::string& name = pScopes_->name(reference.name);
+    if (objects_.contains(name))
+      return;
 
-    index_type depth() const
-    {
-      return depth_;
-    }
+    if (pIndex_ != NULL && pIndex_->contains(name))
+      return;
 
-  private:
-    std::set<std::string> values_;
-    index_type depth_;
-  };
+    const Token& token = pNode->token();
+    collections::Range range(token.position(), token.position() + token.size());
+    pDiagnostics->addWarning(
+        "use of undefined symbol '" + token.contents() + "'",
+        range);
+  }
+
+private:
 
-  Context& current()
+  static const r::SearchPathObjects& update(r::SearchPathObjects& objects)
   {
-    return stack_[stack_.size() - 1];
+    objects.update();
+    return objects;
   }
 
-  void push(const ParseNode* pNode, index_type depth)
-  {
-    stack_.push_back(Context(depth));
+  const ScopeAnalysis* pScopes_;
+  const r::SearchPathObjects& objects_;
+  const SymbolIndex* pIndex_;
+};
 
-    ParseNode* pFormals = pNode->children()[0];
-    const std::vector<ParseNode*>& children = pFormals->children();
-    for (std::vector<ParseNode*>::const_iterator it = children.begin();
-         it != children.end();
-         ++it)
-    {
-      const Token& token = (*it)->token();
-      if (token.isType(tokens::SYMBOL))
-        add(token);
-      else if (token.isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS))
-      {
-        const Token& lhs = (*it)->children()[0]->token();
-        if (lhs.isType(tokens::SYMBOL))
-          add(lhs);
-      }
-    }
+/**
+ * Report variables assigned within a function whose value is never
+ * read, e.g.
+ *
+ *    function() { x <- compute(); 1 }
+ *
+ * Formals and loop variables are not reported, as leaving those unused
+ * is common and intentional.
+ */
+class UnusedVariableChecker : public CheckerBase
+{
+public:
+
+  UnusedVariableChecker()
+    : pScopes_(NULL)
+  {
   }
 
-  void pop()
+  void tokenTypes(std::vector<TokenType>* pTypes) const
   {
-    stack_.pop_back();
+    pTypes->push_back(tokens::SYMBOL);
+    pTypes->push_back(tokens::STRING);
   }
 
-  void add(const Token& token)
+  void prepare(const ScopeAnalysis& scopes)
   {
-    current().add(token);
+    pScopes_ = &scopes;
   }
 
-  void check(const Token& token, Diagnostics* pDiagnostics)
+  void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
   {
-    if (!token.isType(tokens::SYMBOL))
+    index_type index = pScopes_->definition(pNode);
+    if (index == -1)
       return;
 
-    std::string contents = token.contents();
-    for (std::vector<Context>::const_iterator it = stack_.begin();
-         it != stack_.end();
-         ++it)
-    {
-      if (it->contains(contents))
-      {
-        return;
-      }
-    }
+    const ScopeAnalysis::Definition& definition = pScopes_->definitions()[index];
+    if (definition.kind != ScopeAnalysis::DEFINITION_ASSIGNMENT)
+      return;
 
-    if (objects_.count(token.contents()))
+    // Only report the first definition of a name in a scope.
+    const ScopeAnalysis::Binding& binding = pScopes_->bindings()[definition.binding];
+    if (binding.definition != index || binding.uses != 0 || binding.scope == 0)
       return;
 
-    collections::Range range(token.position(), token.position() + token.size());
-    pDiagnostics->addWarning(
-        "use of undefined symbol '" + token.contents() + "'",
-        range);
+    pDiagnostics->addInfo(
+      "local variable '" + pScopes_->name(binding.name) + "' is assigned but never used",
+      pNode->range());
   }
 
-  std::vector<Context> stack_;
-  std::set<std::string> objects_;
-
+private:
+  const ScopeAnalysis* pScopes_;
 };
 
 } // namespace checkers
@@ -66,6 +66,8 @@ public:
     add(DIAGNOSTIC_INFO, message, range);
   }
 
+  void clear() { diagnostics_.clear(); }
+
   operator const std::vector<Diagnostic>&() const { return diagnostics_; }
 
 private:
@@ -92,6 +94,8 @@ inline SEXP create(diagnostics::DiagnosticType type)
   return Rf_mkString("error");
 }
 
+// Diagnostics are reported as lists with 0-based lines and columns
+// (columns counting bytes).
 inline SEXP create(const diagnostics::Diagnostic& diagnostic)
 {
   using namespace diagnostics;
@@ -119,6 +123,72 @@ inline SEXP create(const std::vector<diagnostics::Diagnostic>& diagnostics)
   return resultSEXP;
 }
 
+// Create a data frame with one row per diagnostic, allocating each
+// column once rather than a list per diagnostic. 'files' holds the
+// index of the file each diagnostic was found in, reported 1-based.
+// Unlike the lists above, lines and columns are 1-based, and the end is
+// inclusive: 'end_column' is the column of the last byte, as 'col2' is
+// in 'parse_data()'. (The end of a 'Range' is exclusive and 0-based,
+// and so has the same value.)
+inline SEXP createDataFrame(const std::vector<diagnostics::Diagnostic>& diagnostics,
+                            const std::vector<index_type>& files)
+{
+  using namespace diagnostics;
+
+  index_type n = diagnostics.size();
+
+  RObjectFactory factory;
+  SEXP resultSEXP    = factory.create(VECSXP, 7);
+  SEXP fileSEXP      = factory.create(INTSXP, n);
+  SEXP typeSEXP      = factory.create(INTSXP, n);
+  SEXP lineSEXP      = factory.create(INTSXP, n);
+  SEXP columnSEXP    = factory.create(INTSXP, n);
+  SEXP endLineSEXP   = factory.create(INTSXP, n);
+  SEXP endColumnSEXP = factory.create(INTSXP, n);
+  SEXP messageSEXP   = factory.create(STRSXP, n);
+
+  for (index_type i = 0; i < n; ++i)
+  {
+    const Diagnostic& diagnostic = diagnostics[i];
+    const collections::Range& range = diagnostic.range();
+
+    INTEGER(fileSEXP)[i]      = files[i] + 1;
+    INTEGER(typeSEXP)[i]      = diagnostic.type() + 1;
+    INTEGER(lineSEXP)[i]      = range.start().row + 1;
+    INTEGER(columnSEXP)[i]    = range.start().column + 1;
+    INTEGER(endLineSEXP)[i]   = range.end().row + 1;
+    INTEGER(endColumnSEXP)[i] = range.end().column;
+    SET_STRING_ELT(messageSEXP, i, createChar(diagnostic.message()));
+  }
+
+  // Types are stored as a factor, with levels in 'DiagnosticType' order.
+  const char* levels[] = {"error", "warning", "info", "style"};
+  SEXP levelsSEXP = factory.create(STRSXP, 4);
+  for (index_type i = 0; i < 4; ++i)
+    SET_STRING_ELT(levelsSEXP, i, Rf_mkChar(levels[i]));
+  Rf_setAttrib(typeSEXP, R_LevelsSymbol, levelsSEXP);
+
+  SEXP classSEXP = factory.create(STRSXP, 1);
+  SET_STRING_ELT(classSEXP, 0, Rf_mkChar("factor"));
+  Rf_setAttrib(typeSEXP, R_ClassSymbol, classSEXP);
+
+  SET_VECTOR_ELT(resultSEXP, 0, fileSEXP);
+  SET_VECTOR_ELT(resultSEXP, 1, typeSEXP);
+  SET_VECTOR_ELT(resultSEXP, 2, lineSEXP);
+  SET_VECTOR_ELT(resultSEXP, 3, columnSEXP);
+  SET_VECTOR_ELT(resultSEXP, 4, endLineSEXP);
+  SET_VECTOR_ELT(resultSEXP, 5, endColumnSEXP);
+  SET_VECTOR_ELT(resultSEXP, 6, messageSEXP);
+
+  const char* names[] = {
+    "file", "type", "line", "column", "end_line", "end_column", "message"
+  };
+  util::setNames(resultSEXP, names, 7);
+  util::listToDataFrame(resultSEXP, n);
+
+  return resultSEXP;
+}
+
 } // namespace r
 
 } // namespace sourcetools
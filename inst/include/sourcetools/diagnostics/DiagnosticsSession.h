@@ -0,0 +1,277 @@
+#ifndef SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_SESSION_H
+#define SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_SESSION_H
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/parse/parse.h>
+#include <sourcetools/diagnostics/Diagnostic.h>
+#include <sourcetools/diagnostics/DiagnosticsSet.h>
+#include <sourcetools/diagnostics/ScopeAnalysis.h>
+#include <sourcetools/diagnostics/SymbolIndex.h>
+
+namespace sourcetools {
+namespace diagnostics {
+
+// Diagnoses successive versions of a document, as it is edited.
+//
+// The checkers are run on each top-level expression on its own, and
+// their results are cached, keyed by a hash of the expression's text.
+// When a new version is diagnosed, only the expressions that changed
+// are checked again, along with those that refer to a name whose
+// top-level definition was added or removed elsewhere; the results for
+// the other expressions are reused, moved to wherever those expressions
+// now are. The result is the same as checking the whole document.
+class DiagnosticsSession : noncopyable
+{
+  typedef parser::ParseNode ParseNode;
+  typedef collections::Position Position;
+  typedef collections::Range Range;
+
+public:
+
+  DiagnosticsSession()
+    : generation_(-1), checked_(0)
+  {
+  }
+
+  const std::vector<Diagnostic>& run(const std::string& code,
+                                     const r::SearchPathObjects& objects)
+  {
+    parser::Parser parser(code);
+    parser::ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+
+    const std::vector<ParseNode*>& expressions = pRoot->children();
+    index_type n = utils::size(expressions);
+
+    // Find the cached results for each expression, and analyze the
+    // scopes of those that are new.
+    bool stale = objects.generation() != generation_;
+    std::vector<Entry> entries(n);
+    std::vector<bool> dirty(n, false);
+    std::vector<std::string> names;
+    for (index_type i = 0; i < n; ++i)
+    {
+      Entry& entry = entries[i];
+      entry.text = text(expressions[i]);
+
+      const Entry* pCached = find(entry.text);
+      if (pCached == NULL)
+      {
+        analyze(expressions[i], &entry);
+        dirty[i] = true;
+      }
+      else
+      {
+        entry = *pCached;
+        dirty[i] = stale;
+      }
+
+      names.insert(names.end(), entry.definitions.begin(), entry.definitions.end());
+    }
+
+    sortUnique(&names);
+
+    // Expressions referring to names whose definitions came or went must
+    // be checked again, even if they did not change themselves.
+    std::vector<std::string> changed;
+    std::set_symmetric_difference(
+      names.begin(), names.end(),
+      names_.begin(), names_.end(),
+      std::back_inserter(changed));
+
+    for (index_type i = 0; i < n && !changed.empty(); ++i)
+      dirty[i] = dirty[i] || intersects(entries[i].externals, changed);
+
+    SymbolIndex index;
+    for (std::vector<std::string>::const_iterator it = names.begin();
+         it != names.end();
+         ++it)
+    {
+      index.add(*it);
+    }
+    index.finalize();
+
+    scoped_ptr<DiagnosticsSet> pSet(createDefaultDiagnosticsSet(objects, &index));
+
+    checked_ = 0;
+    diagnostics_.clear();
+    for (index_type i = 0; i < n; ++i)
+    {
+      const ParseNode* pNode = expressions[i];
+      Entry& entry = entries[i];
+
+      if (dirty[i])
+      {
+        pSet->clear();
+        const std::vector<Diagnostic>& results = pSet->run(pNode);
+
+        entry.diagnostics.clear();
+        for (std::vector<Diagnostic>::const_iterator it = results.begin();
+             it != results.end();
+             ++it)
+        {
+          entry.diagnostics.push_back(move(*it, start(pNode), Position(0, 0)));
+        }
+
+        ++checked_;
+      }
+
+      for (std::vector<Diagnostic>::const_iterator it = entry.diagnostics.begin();
+           it != entry.diagnostics.end();
+           ++it)
+      {
+        diagnostics_.push_back(move(*it, Position(0, 0), start(pNode)));
+      }
+    }
+
+    // Only keep the results for the current version of the document.
+    cache_.clear();
+    for (index_type i = 0; i < n; ++i)
+    {
+      if (!entries[i].text.empty())
+        cache_.insert(std::make_pair(hash::compute(entries[i].text), entries[i]));
+    }
+
+    names_.swap(names);
+    generation_ = objects.generation();
+    return diagnostics_;
+  }
+
+  // The number of top-level expressions checked by the last run.
+  index_type checked() const
+  {
+    return checked_;
+  }
+
+private:
+
+  struct Entry
+  {
+    std::string text;
+
+    // Diagnostics, with positions relative to the start of the expression.
+    std::vector<Diagnostic> diagnostics;
+
+    // The names the expression binds at the top level, and those it
+    // refers to without binding them itself, both sorted.
+    std::vector<std::string> definitions;
+    std::vector<std::string> externals;
+  };
+
+  typedef std::multimap<hash_type, Entry> Cache;
+
+  const Entry* find(const std::string& text) const
+  {
+    if (text.empty())
+      return NULL;
+
+    std::pair<Cache::const_iterator, Cache::const_iterator> range =
+      cache_.equal_range(hash::compute(text));
+
+    for (Cache::const_iterator it = range.first; it != range.second; ++it)
+      if (it->second.text == text)
+        return &it->second;
+
+    return NULL;
+  }
+
+  static void analyze(const ParseNode* pNode, Entry* pEntry)
+  {
+    ScopeAnalysis scopes(pNode);
+
+    const std::vector<ScopeAnalysis::Binding>& bindings = scopes.bindings();
+    for (std::vector<ScopeAnalysis::Binding>::const_iterator it = bindings.begin();
+         it != bindings.end();
+         ++it)
+    {
+      if (it->scope == 0)
+        pEntry->definitions.push_back(scopes.name(it->name));
+    }
+
+    const std::vector<ScopeAnalysis::Reference>& references = scopes.references();
+    for (std::vector<ScopeAnalysis::Reference>::const_iterator it = references.begin();
+         it != references.end();
+         ++it)
+    {
+      if (it->binding == -1)
+        pEntry->externals.push_back(scopes.name(it->name));
+    }
+
+    sortUnique(&pEntry->definitions);
+    sortUnique(&pEntry->externals);
+  }
+
+  // The text spanned by an expression. Positions within an expression
+  // are kept relative to its start, so its layout is part of the key.
+  // Expressions without a valid range (e.g. after a parse error) are
+  // never cached.
+  static std::string text(const ParseNode* pNode)
+  {
+    const tokens::Token& begin = pNode->begin();
+    const tokens::Token& end = pNode->end();
+    if (begin.offset() == -1 || end.offset() == -1 || end.end() <= begin.begin())
+      return std::string();
+    return std::string(begin.begin(), end.end());
+  }
+
+  static Position start(const ParseNode* pNode)
+  {
+    return pNode->begin().position();
+  }
+
+  // Move a position from one origin to another. Rows are offset as a
+  // whole, but columns only on the first row: later rows begin at the
+  // start of a line, wherever the expression starts.
+  static Position move(const Position& position, const Position& from, const Position& to)
+  {
+    if (position.row == from.row)
+      return Position(to.row, position.column - from.column + to.column);
+    return Position(position.row - from.row + to.row, position.column);
+  }
+
+  static Diagnostic move(const Diagnostic& diagnostic, const Position& from, const Position& to)
+  {
+    Range range(move(diagnostic.start(), from, to), move(diagnostic.end(), from, to));
+    return Diagnostic(diagnostic.type(), diagnostic.message(), range);
+  }
+
+  static bool intersects(const std::vector<std::string>& lhs,
+                         const std::vector<std::string>& rhs)
+  {
+    std::vector<std::string>::const_iterator i = lhs.begin(), j = rhs.begin();
+    while (i != lhs.end() && j != rhs.end())
+    {
+      if (*i < *j)
+        ++i;
+      else if (*j < *i)
+        ++j;
+      else
+        return true;
+    }
+    return false;
+  }
+
+  static void sortUnique(std::vector<std::string>* pNames)
+  {
+    std::sort(pNames->begin(), pNames->end());
+    pNames->erase(std::unique(pNames->begin(), pNames->end()), pNames->end());
+  }
+
+  Cache cache_;
+  std::vector<std::string> names_;
+  index_type generation_;
+
+  std::vector<Diagnostic> diagnostics_;
+  index_type checked_;
+};
+
+} // namespace diagnostics
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_SESSION_H */
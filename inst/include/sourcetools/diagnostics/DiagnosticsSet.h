@@ -1,15 +1,24 @@
 #ifndef SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_SET_H
 #define SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_SET_H
 
+#include <map>
+#include <vector>
+
 #include <sourcetools/diagnostics/Diagnostic.h>
 #include <sourcetools/diagnostics/Checkers.h>
+#include <sourcetools/diagnostics/ScopeAnalysis.h>
 
 namespace sourcetools {
 namespace diagnostics {
 
+// Applies a set of checkers to every node of a parse tree. Checkers
+// declaring the token types they are interested in are indexed by those
+// types up front, so that each node only visits the checkers that can
+// act on it, in the order they were added.
 class DiagnosticsSet
 {
   typedef std::vector<checkers::CheckerBase*> Checkers;
+  typedef std::map<tokens::TokenType, Checkers> Dispatch;
   typedef checkers::CheckerBase CheckerBase;
   typedef parser::ParseNode ParseNode;
 
@@ -18,14 +27,53 @@ public:
   void add(CheckerBase* pChecker)
   {
     checkers_.push_back(pChecker);
+
+    std::vector<tokens::TokenType> types;
+    pChecker->tokenTypes(&types);
+
+    if (types.empty())
+    {
+      // Applies to every node, including those of types already indexed.
+      generic_.push_back(pChecker);
+      for (Dispatch::iterator it = dispatch_.begin(); it != dispatch_.end(); ++it)
+        it->second.push_back(pChecker);
+      return;
+    }
+
+    for (std::vector<tokens::TokenType>::const_iterator it = types.begin();
+         it != types.end();
+         ++it)
+    {
+      Dispatch::iterator entry = dispatch_.find(*it);
+      if (entry == dispatch_.end())
+        entry = dispatch_.insert(std::make_pair(*it, generic_)).first;
+
+      Checkers& checkers = entry->second;
+      if (checkers.empty() || checkers.back() != pChecker)
+        checkers.push_back(pChecker);
+    }
   }
 
+  // Check a tree, adding to the diagnostics found in earlier runs.
   const std::vector<Diagnostic>& run(const ParseNode* pNode)
   {
+    ScopeAnalysis scopes(pNode);
+    for (Checkers::const_iterator it = checkers_.begin();
+         it != checkers_.end();
+         ++it)
+    {
+      (*it)->prepare(scopes);
+    }
+
     runImpl(pNode);
     return diagnostics_;
   }
 
+  void clear()
+  {
+    diagnostics_.clear();
+  }
+
   void report()
   {
     const std::vector<Diagnostic>& diagnostics = diagnostics_;
@@ -49,40 +97,74 @@ public:
   }
 
 private:
-  void runImpl(const ParseNode* pNode, index_type depth = 0)
+  const Checkers& checkersFor(tokens::TokenType type) const
   {
-    for (Checkers::iterator it = checkers_.begin();
-         it != checkers_.end();
-         ++it)
-    {
-      (*it)->apply(pNode, &diagnostics_, depth);
-    }
+    Dispatch::const_iterator it = dispatch_.find(type);
+    return it == dispatch_.end() ? generic_ : it->second;
+  }
 
-    for (std::vector<ParseNode*>::const_iterator it = pNode->children().begin();
-         it != pNode->children().end();
-         ++it)
+  // Visit the nodes in pre-order, with an explicit stack so that deeply
+  // nested code cannot overflow the C stack.
+  void runImpl(const ParseNode* pRoot)
+  {
+    std::vector< std::pair<const ParseNode*, index_type> > stack;
+    stack.push_back(std::make_pair(pRoot, 0));
+
+    while (!stack.empty())
     {
-      runImpl(*it, depth + 1);
+      const ParseNode* pNode = stack.back().first;
+      index_type depth = stack.back().second;
+      stack.pop_back();
+
+      const Checkers& checkers = checkersFor(pNode->token().type());
+      for (Checkers::const_iterator it = checkers.begin();
+           it != checkers.end();
+           ++it)
+      {
+        (*it)->apply(pNode, &diagnostics_, depth);
+      }
+
+      for (std::vector<ParseNode*>::const_reverse_iterator it = pNode->children().rbegin();
+           it != pNode->children().rend();
+           ++it)
+      {
+        stack.push_back(std::make_pair(*it, depth + 1));
+      }
     }
   }
 
 
 private:
   Checkers checkers_;
+  Checkers generic_;
+  Dispatch dispatch_;
   Diagnostics diagnostics_;
 };
 
-inline DiagnosticsSet* createDefaultDiagnosticsSet()
+// Create the default set of checkers, looking up undefined symbols in
+// 'objects' and, when given, 'pIndex'. Unlike the overload below, this
+// does not call into R, so sets can be created and used on other
+// threads.
+inline DiagnosticsSet* createDefaultDiagnosticsSet(const r::SearchPathObjects& objects,
+                                                   const SymbolIndex* pIndex = NULL)
 {
   DiagnosticsSet* pSet = new DiagnosticsSet();
   pSet->add(new checkers::AssignmentInIfChecker);
   pSet->add(new checkers::ComparisonWithNullChecker);
   pSet->add(new checkers::ScalarOpsInIfChecker);
   pSet->add(new checkers::UnusedResultChecker);
-  pSet->add(new checkers::NoSymbolInScopeChecker);
+  pSet->add(new checkers::NoSymbolInScopeChecker(objects, pIndex));
+  pSet->add(new checkers::UnusedVariableChecker);
   return pSet;
 }
 
+inline DiagnosticsSet* createDefaultDiagnosticsSet(const SymbolIndex* pIndex = NULL)
+{
+  r::SearchPathObjects& objects = r::searchPathObjects();
+  objects.update();
+  return createDefaultDiagnosticsSet(objects, pIndex);
+}
+
 } // namespace diagnostics
 } // namespace sourcetools
 
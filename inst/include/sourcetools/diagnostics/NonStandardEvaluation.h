@@ -0,0 +1,284 @@
+#ifndef SOURCETOOLS_DIAGNOSTICS_NON_STANDARD_EVALUATION_H
+#define SOURCETOOLS_DIAGNOSTICS_NON_STANDARD_EVALUATION_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/collection/collection.h>
+#include <sourcetools/parse/ParseNode.h>
+#include <sourcetools/parse/Names.h>
+
+namespace sourcetools {
+namespace diagnostics {
+
+// Finds the functions defined at the top level of R source that perform
+// non-standard evaluation, from their parse trees alone, so that code
+// can be analyzed without loading (or even installing) the packages it
+// belongs to. The analysis follows that of closures in 'r::nse': a
+// function performs non-standard evaluation if its body calls one of
+// the functions capturing or evaluating unevaluated code, or forwards
+// its '...' arguments to a function (defined in the sources analyzed)
+// that does. It recognizes more functions by name, however; see
+// 'kNseFunctions'.
+//
+// Finding the functions in a file touches nothing but its parse tree,
+// so files can be handled on separate threads; the results are then
+// combined with 'propagateNse()'.
+struct NseFunction
+{
+  std::string name;
+  collections::Position position;  // of the name being defined
+  index_type file;
+
+  // Whether the body calls a function performing non-standard
+  // evaluation itself, and the names of the functions it forwards
+  // '...' to, sorted.
+  bool direct;
+  std::vector<std::string> forwards;
+
+  // The result, once propagated.
+  bool status;
+};
+
+namespace detail {
+
+// The functions whose use marks the caller as performing non-standard
+// evaluation. This is deliberately a superset of the table used by
+// 'r::nse' ('kNsePrimitives'). That analysis works on loaded closures,
+// and can follow '...' into any function reachable from them. Here only
+// the sources given are seen: functions from base R or from packages
+// such as rlang cannot be inspected, so those capturing their caller's
+// arguments or call ('enquo()', 'match.call()', ...) are recognized by
+// name. The two analyses may therefore disagree, with this one finding
+// more functions.
+static const char* const kNseFunctions[] = {
+  "bquote",
+  "enexpr",
+  "enexprs",
+  "enquo",
+  "enquos",
+  "ensym",
+  "ensyms",
+  "eval",
+  "eval_tidy",
+  "evalq",
+  "expr",
+  "exprs",
+  "lazy_dots",
+  "match.call",
+  "quo",
+  "quos",
+  "quote",
+  "substitute",
+  "sys.call"
+};
+
+inline bool isNseFunction(const std::string& name)
+{
+  return names::contains(kNseFunctions, name.c_str());
+}
+
+inline bool isDots(const parser::ParseNode* pNode)
+{
+  // Named arguments hold the name and the value.
+  if (pNode->token().isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS) &&
+      pNode->children().size() == 2)
+  {
+    pNode = pNode->children()[1];
+  }
+
+  return pNode->token().isType(tokens::SYMBOL) &&
+         pNode->token().contentsEqual("...");
+}
+
+// The function called by a call node, by name; empty if the function is
+// not called by name. Functions called as 'pkg::name' are only known by
+// 'name'.
+inline std::string callee(const parser::ParseNode* pCall, bool* pQualified)
+{
+  using namespace tokens;
+
+  const parser::ParseNode* pFunction = pCall->children()[0];
+  const Token& token = pFunction->token();
+
+  *pQualified = false;
+  if ((token.isType(OPERATOR_NAMESPACE_EXPORTS) || token.isType(OPERATOR_NAMESPACE_ALL)) &&
+      pFunction->children().size() == 2)
+  {
+    *pQualified = true;
+    pFunction = pFunction->children()[1];
+  }
+
+  if (!names::isName(pFunction))
+    return std::string();
+
+  return names::value(pFunction->token());
+}
+
+// Walk a function's body, stopping at the first direct use of
+// non-standard evaluation.
+inline void summarize(const parser::ParseNode* pBody, NseFunction* pFunction)
+{
+  using namespace tokens;
+
+  pFunction->direct = false;
+
+  std::vector<const parser::ParseNode*> stack(1, pBody);
+  while (!stack.empty())
+  {
+    const parser::ParseNode* pNode = stack.back();
+    stack.pop_back();
+
+    const std::vector<parser::ParseNode*>& children = pNode->children();
+    if (pNode->token().isType(LPAREN) && children.size() > 1)
+    {
+      bool qualified;
+      std::string calleeName = callee(pNode, &qualified);
+      if (isNseFunction(calleeName))
+      {
+        pFunction->direct = true;
+        pFunction->forwards.clear();
+        return;
+      }
+
+      if (!qualified && !calleeName.empty())
+      {
+        for (index_type i = 1; i < utils::size(children); ++i)
+        {
+          if (isDots(children[i]))
+          {
+            pFunction->forwards.push_back(calleeName);
+            break;
+          }
+        }
+      }
+    }
+
+    stack.insert(stack.end(), children.rbegin(), children.rend());
+  }
+
+  std::vector<std::string>& forwards = pFunction->forwards;
+  std::sort(forwards.begin(), forwards.end());
+  forwards.erase(std::unique(forwards.begin(), forwards.end()), forwards.end());
+}
+
+} // namespace detail
+
+// Find the functions defined at the top level of a parse tree, e.g. as
+// 'f <- function(...) ...', including through chained assignments.
+inline void findNseFunctions(const parser::ParseNode* pRoot,
+                             index_type file,
+                             std::vector<NseFunction>* pFunctions)
+{
+  using namespace tokens;
+
+  const std::vector<parser::ParseNode*>& expressions = pRoot->children();
+  for (index_type i = 0; i < utils::size(expressions); ++i)
+  {
+    std::vector<const parser::ParseNode*> targets;
+    const parser::ParseNode* pNode = expressions[i];
+    while (pNode->children().size() == 2)
+    {
+      const Token& token = pNode->token();
+      bool right =
+        token.isType(OPERATOR_ASSIGN_RIGHT) ||
+        token.isType(OPERATOR_ASSIGN_RIGHT_PARENT);
+      bool left =
+        token.isType(OPERATOR_ASSIGN_LEFT) ||
+        token.isType(OPERATOR_ASSIGN_LEFT_EQUALS) ||
+        token.isType(OPERATOR_ASSIGN_LEFT_PARENT);
+
+      if (!left && !right)
+        break;
+
+      const parser::ParseNode* pTarget = pNode->children()[right ? 1 : 0];
+      if (!names::isName(pTarget))
+        break;
+
+      targets.push_back(pTarget);
+      pNode = pNode->children()[right ? 0 : 1];
+    }
+
+    if (targets.empty() ||
+        !pNode->token().isType(KEYWORD_FUNCTION) ||
+        pNode->children().size() != 2)
+    {
+      continue;
+    }
+
+    NseFunction function;
+    function.file = file;
+    function.status = false;
+    detail::summarize(pNode->children()[1], &function);
+
+    for (index_type j = 0; j < utils::size(targets); ++j)
+    {
+      function.name = names::value(targets[j]->token());
+      function.position = targets[j]->token().position();
+      pFunctions->push_back(function);
+    }
+  }
+}
+
+// Propagate the property from the functions performing non-standard
+// evaluation to those forwarding '...' to them, by name, until nothing
+// changes. When a name is defined more than once, forwarding to it is
+// taken to perform non-standard evaluation if any definition does.
+inline void propagateNse(std::vector<NseFunction>* pFunctions)
+{
+  std::vector<NseFunction>& functions = *pFunctions;
+  index_type n = utils::size(functions);
+
+  std::map<std::string, std::vector<index_type> > definitions;
+  for (index_type i = 0; i < n; ++i)
+    definitions[functions[i].name].push_back(i);
+
+  // The functions forwarding to each function.
+  std::vector< std::vector<index_type> > callers(n);
+  for (index_type i = 0; i < n; ++i)
+  {
+    const std::vector<std::string>& forwards = functions[i].forwards;
+    for (index_type j = 0; j < utils::size(forwards); ++j)
+    {
+      std::map<std::string, std::vector<index_type> >::const_iterator it =
+        definitions.find(forwards[j]);
+      if (it == definitions.end())
+        continue;
+
+      for (index_type k = 0; k < utils::size(it->second); ++k)
+        callers[it->second[k]].push_back(i);
+    }
+  }
+
+  std::vector<index_type> stack;
+  for (index_type i = 0; i < n; ++i)
+  {
+    functions[i].status = functions[i].direct;
+    if (functions[i].status)
+      stack.push_back(i);
+  }
+
+  while (!stack.empty())
+  {
+    index_type index = stack.back();
+    stack.pop_back();
+
+    for (index_type i = 0; i < utils::size(callers[index]); ++i)
+    {
+      NseFunction& caller = functions[callers[index][i]];
+      if (caller.status)
+        continue;
+
+      caller.status = true;
+      stack.push_back(callers[index][i]);
+    }
+  }
+}
+
+} // namespace diagnostics
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_DIAGNOSTICS_NON_STANDARD_EVALUATION_H */
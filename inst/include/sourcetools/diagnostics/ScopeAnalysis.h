@@ -0,0 +1,449 @@
+#ifndef SOURCETOOLS_DIAGNOSTICS_SCOPE_ANALYSIS_H
+#define SOURCETOOLS_DIAGNOSTICS_SCOPE_ANALYSIS_H
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/parse/ParseNode.h>
+#include <sourcetools/parse/Names.h>
+
+namespace sourcetools {
+namespace diagnostics {
+
+// Resolves the symbols in a parse tree against the scopes they are
+// defined in.
+//
+// The top level of the tree and each function definition open a scope.
+// A name is bound in a scope by function formals, '<-', '=', '->',
+// 'for' loop variables and calls to 'assign()' with a literal name (and
+// no environment); '<<-' and '->>' bind the name in the nearest
+// enclosing scope that binds it already, or at the top level otherwise.
+// As in R, where a binding happens within its scope does not matter:
+// every reference resolves to the innermost enclosing scope binding its
+// name.
+//
+// The results are kept in flat tables that refer to each other by
+// index, so checkers can ask how a symbol resolves, whether a binding
+// is ever used, or which binding it shadows, without walking the tree
+// again.
+class ScopeAnalysis : noncopyable
+{
+public:
+  typedef parser::ParseNode ParseNode;
+  typedef tokens::Token Token;
+
+  enum DefinitionKind
+  {
+    DEFINITION_FORMAL,
+    DEFINITION_ASSIGNMENT,
+    DEFINITION_SUPER_ASSIGNMENT,
+    DEFINITION_FOR
+  };
+
+  struct Scope
+  {
+    const ParseNode* pNode;  // the root, or a 'function' node
+    index_type parent;       // -1 for the top level
+  };
+
+  // All the definitions of one name in one scope.
+  struct Binding
+  {
+    index_type name;
+    index_type scope;
+    index_type definition;   // the first definition of the name
+    index_type uses;         // references, and super-assignments
+  };
+
+  struct Definition
+  {
+    const ParseNode* pNode;  // the node holding the name
+    DefinitionKind kind;
+    index_type binding;
+  };
+
+  struct Reference
+  {
+    const ParseNode* pNode;
+    index_type name;
+    index_type scope;
+    index_type binding;      // -1 when not bound in the tree
+  };
+
+  explicit ScopeAnalysis(const ParseNode* pRoot)
+  {
+    collect(pRoot);
+    resolve();
+  }
+
+  const std::vector<Scope>& scopes() const { return scopes_; }
+  const std::vector<Binding>& bindings() const { return bindings_; }
+  const std::vector<Definition>& definitions() const { return definitions_; }
+  const std::vector<Reference>& references() const { return references_; }
+
+  const std::string& name(index_type name) const
+  {
+    return names_[name];
+  }
+
+  // The reference made by a symbol node, or -1 if the node is not a
+  // reference (e.g. the name of an argument, or the target of '$').
+  index_type reference(const ParseNode* pNode) const
+  {
+    return find(referenceOffsets_, pNode);
+  }
+
+  // The definition made by a node, or -1 if it defines nothing.
+  index_type definition(const ParseNode* pNode) const
+  {
+    return find(definitionOffsets_, pNode);
+  }
+
+  // The binding of the same name in the nearest enclosing scope that a
+  // binding hides, or -1 if it hides nothing.
+  index_type shadowed(index_type binding) const
+  {
+    const Binding& self = bindings_[binding];
+    return lookup(scopes_[self.scope].parent, self.name);
+  }
+
+private:
+
+  typedef std::pair<index_type, index_type> Key;
+  typedef std::vector<std::pair<index_type, index_type> > Offsets;
+
+  struct Pending
+  {
+    const ParseNode* pNode;
+    index_type scope;
+  };
+
+  struct SuperAssignment
+  {
+    const ParseNode* pNode;
+    index_type name;
+    index_type scope;
+  };
+
+  // Walk the tree, recording scopes, definitions and references. Only
+  // bindings made directly in a scope are known at this point.
+  void collect(const ParseNode* pRoot)
+  {
+    using namespace tokens;
+
+    Scope root = { pRoot, -1 };
+    scopes_.push_back(root);
+
+    std::vector<Pending> stack;
+    push(&stack, pRoot, 0);
+
+    while (!stack.empty())
+    {
+      Pending pending = stack.back();
+      stack.pop_back();
+
+      const ParseNode* pNode = pending.pNode;
+      index_type scope = pending.scope;
+      const Token& token = pNode->token();
+      const std::vector<ParseNode*>& children = pNode->children();
+      index_type n = utils::size(children);
+
+      if (token.isType(SYMBOL))
+      {
+        Reference reference = { pNode, intern(token), scope, -1 };
+        add(&referenceOffsets_, pNode, utils::size(references_));
+        references_.push_back(reference);
+        continue;
+      }
+
+      if (token.isType(KEYWORD_FUNCTION))
+      {
+        Scope function = { pNode, scope };
+        index_type inner = utils::size(scopes_);
+        scopes_.push_back(function);
+
+        if (n > 1)
+          push(&stack, children[1], inner);
+        if (n > 0)
+          formals(&stack, children[0], inner);
+        continue;
+      }
+
+      if (token.isType(KEYWORD_FOR))
+      {
+        for (index_type i = n - 1; i > 0; --i)
+          push(&stack, children[i], scope);
+        if (n > 0 && !define(children[0], scope, DEFINITION_FOR))
+          push(&stack, children[0], scope);
+        continue;
+      }
+
+      if (isAssignment(token) && n == 2)
+      {
+        bool right =
+          token.isType(OPERATOR_ASSIGN_RIGHT) ||
+          token.isType(OPERATOR_ASSIGN_RIGHT_PARENT);
+        bool super =
+          token.isType(OPERATOR_ASSIGN_LEFT_PARENT) ||
+          token.isType(OPERATOR_ASSIGN_RIGHT_PARENT);
+
+        const ParseNode* pTarget = children[right ? 1 : 0];
+        const ParseNode* pValue  = children[right ? 0 : 1];
+
+        push(&stack, pValue, scope);
+        if (!names::isName(pTarget))
+          push(&stack, pTarget, scope);
+        else if (super)
+          superAssign(pTarget, scope);
+        else
+          define(pTarget, scope, DEFINITION_ASSIGNMENT);
+        continue;
+      }
+
+      if (isCall(pNode))
+      {
+        for (index_type i = n - 1; i > 0; --i)
+        {
+          // Skip the names of named arguments.
+          const ParseNode* pArgument = children[i];
+          if (pArgument->token().isType(OPERATOR_ASSIGN_LEFT_EQUALS))
+          {
+            if (pArgument->children().size() > 1)
+              push(&stack, pArgument->children()[1], scope);
+            continue;
+          }
+
+          push(&stack, pArgument, scope);
+        }
+
+        // A call to 'assign()' with a literal name defines that name.
+        const ParseNode* pFunction = children[0];
+        if (isLocalAssign(pNode))
+          define(children[1], scope, DEFINITION_ASSIGNMENT);
+
+        push(&stack, pFunction, scope);
+        continue;
+      }
+
+      // Only the object is evaluated in 'x$y' and 'x@y', and nothing
+      // is looked up in scope for 'pkg::x'.
+      if (token.isType(OPERATOR_DOLLAR) || token.isType(OPERATOR_AT))
+      {
+        if (n > 0)
+          push(&stack, children[0], scope);
+        continue;
+      }
+
+      if (token.isType(OPERATOR_NAMESPACE_EXPORTS) ||
+          token.isType(OPERATOR_NAMESPACE_ALL))
+      {
+        continue;
+      }
+
+      for (index_type i = n - 1; i >= 0; --i)
+        push(&stack, children[i], scope);
+    }
+  }
+
+  // Resolve super-assignments, then references, against the bindings
+  // collected for each scope.
+  void resolve()
+  {
+    for (std::vector<SuperAssignment>::const_iterator it = superAssignments_.begin();
+         it != superAssignments_.end();
+         ++it)
+    {
+      index_type parent = scopes_[it->scope].parent;
+      index_type binding = lookup(parent == -1 ? 0 : parent, it->name);
+      if (binding == -1)
+        binding = bind(0, it->name, utils::size(definitions_));
+      else
+        ++bindings_[binding].uses;
+
+      Definition definition = { it->pNode, DEFINITION_SUPER_ASSIGNMENT, binding };
+      add(&definitionOffsets_, it->pNode, utils::size(definitions_));
+      definitions_.push_back(definition);
+    }
+
+    for (std::vector<Reference>::iterator it = references_.begin();
+         it != references_.end();
+         ++it)
+    {
+      it->binding = lookup(it->scope, it->name);
+      if (it->binding != -1)
+        ++bindings_[it->binding].uses;
+    }
+
+    std::sort(referenceOffsets_.begin(), referenceOffsets_.end());
+    std::sort(definitionOffsets_.begin(), definitionOffsets_.end());
+  }
+
+  void formals(std::vector<Pending>* pStack, const ParseNode* pFormals, index_type scope)
+  {
+    const std::vector<ParseNode*>& children = pFormals->children();
+    for (index_type i = utils::size(children) - 1; i >= 0; --i)
+    {
+      const ParseNode* pFormal = children[i];
+      if (pFormal->token().isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS) &&
+          pFormal->children().size() == 2)
+      {
+        // Default values are evaluated within the function.
+        push(pStack, pFormal->children()[1], scope);
+        pFormal = pFormal->children()[0];
+      }
+
+      if (!define(pFormal, scope, DEFINITION_FORMAL))
+        push(pStack, pFormal, scope);
+    }
+  }
+
+  bool define(const ParseNode* pNode, index_type scope, DefinitionKind kind)
+  {
+    if (!names::isName(pNode))
+      return false;
+
+    index_type name = intern(pNode->token());
+    index_type definition = utils::size(definitions_);
+
+    index_type binding = lookup(scope, name);
+    if (binding == -1 || bindings_[binding].scope != scope)
+      binding = bind(scope, name, definition);
+
+    Definition result = { pNode, kind, binding };
+    add(&definitionOffsets_, pNode, definition);
+    definitions_.push_back(result);
+    return true;
+  }
+
+  void superAssign(const ParseNode* pNode, index_type scope)
+  {
+    SuperAssignment assignment = { pNode, intern(pNode->token()), scope };
+    superAssignments_.push_back(assignment);
+  }
+
+  index_type bind(index_type scope, index_type name, index_type definition)
+  {
+    index_type binding = utils::size(bindings_);
+    Binding result = { name, scope, definition, 0 };
+    bindings_.push_back(result);
+    scopeBindings_[Key(scope, name)] = binding;
+    return binding;
+  }
+
+  // Find the binding of a name visible from a scope.
+  index_type lookup(index_type scope, index_type name) const
+  {
+    for (; scope != -1; scope = scopes_[scope].parent)
+    {
+      std::map<Key, index_type>::const_iterator it =
+        scopeBindings_.find(Key(scope, name));
+      if (it != scopeBindings_.end())
+        return it->second;
+    }
+
+    return -1;
+  }
+
+  index_type intern(const Token& token)
+  {
+    std::string value = names::value(token);
+    std::map<std::string, index_type>::const_iterator it = ids_.find(value);
+    if (it != ids_.end())
+      return it->second;
+
+    index_type id = utils::size(names_);
+    names_.push_back(value);
+    ids_[value] = id;
+    return id;
+  }
+
+  static bool isAssignment(const Token& token)
+  {
+    using namespace tokens;
+    return token.isType(OPERATOR_ASSIGN_LEFT) ||
+           token.isType(OPERATOR_ASSIGN_LEFT_EQUALS) ||
+           token.isType(OPERATOR_ASSIGN_LEFT_PARENT) ||
+           token.isType(OPERATOR_ASSIGN_RIGHT) ||
+           token.isType(OPERATOR_ASSIGN_RIGHT_PARENT);
+  }
+
+  // Whether a call is to 'assign()', with a literal name and a value,
+  // and nothing else: given 'pos', 'envir' or 'inherits', the name is
+  // bound in some other environment, not the calling function's.
+  static bool isLocalAssign(const ParseNode* pCall)
+  {
+    using namespace tokens;
+
+    const std::vector<ParseNode*>& children = pCall->children();
+    if (!pCall->token().isType(LPAREN) || children.size() != 3)
+      return false;
+
+    const Token& function = children[0]->token();
+    if (!function.isType(SYMBOL) || !function.contentsEqual("assign"))
+      return false;
+
+    if (!children[1]->token().isType(STRING))
+      return false;
+
+    const ParseNode* pValue = children[2];
+    if (pValue->token().isType(OPERATOR_ASSIGN_LEFT_EQUALS))
+      return pValue->children().size() == 2 &&
+             pValue->children()[0]->token().contentsEqual("value");
+
+    return !pValue->token().isType(EMPTY);
+  }
+
+  // Calls hold the function followed by its arguments; a parenthesized
+  // expression has a single child.
+  static bool isCall(const ParseNode* pNode)
+  {
+    using namespace tokens;
+    const Token& token = pNode->token();
+    return (token.isType(LPAREN) ||
+            token.isType(LBRACKET) ||
+            token.isType(LDBRACKET)) &&
+           pNode->children().size() > 1;
+  }
+
+  static void push(std::vector<Pending>* pStack, const ParseNode* pNode, index_type scope)
+  {
+    Pending pending = { pNode, scope };
+    pStack->push_back(pending);
+  }
+
+  static void add(Offsets* pOffsets, const ParseNode* pNode, index_type index)
+  {
+    pOffsets->push_back(std::make_pair(pNode->token().offset(), index));
+  }
+
+  static index_type find(const Offsets& offsets, const ParseNode* pNode)
+  {
+    std::pair<index_type, index_type> key(pNode->token().offset(), -1);
+    Offsets::const_iterator it =
+      std::lower_bound(offsets.begin(), offsets.end(), key);
+    if (it == offsets.end() || it->first != key.first)
+      return -1;
+    return it->second;
+  }
+
+  std::vector<std::string> names_;
+  std::map<std::string, index_type> ids_;
+
+  std::vector<Scope> scopes_;
+  std::vector<Binding> bindings_;
+  std::vector<Definition> definitions_;
+  std::vector<Reference> references_;
+  std::vector<SuperAssignment> superAssignments_;
+
+  std::map<Key, index_type> scopeBindings_;
+  Offsets referenceOffsets_;
+  Offsets definitionOffsets_;
+};
+
+} // namespace diagnostics
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_DIAGNOSTICS_SCOPE_ANALYSIS_H */
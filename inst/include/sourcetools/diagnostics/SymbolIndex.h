@@ -0,0 +1,91 @@
+#ifndef SOURCETOOLS_DIAGNOSTICS_SYMBOL_INDEX_H
+#define SOURCETOOLS_DIAGNOSTICS_SYMBOL_INDEX_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/parse/ParseNode.h>
+#include <sourcetools/diagnostics/ScopeAnalysis.h>
+
+namespace sourcetools {
+namespace diagnostics {
+
+// The names visible to every file of a package: the objects defined at
+// the top level of any of its files, and those it imports. Checking a
+// file against the index avoids reporting names defined elsewhere in
+// the package as undefined, without having to load the package.
+class SymbolIndex : noncopyable
+{
+public:
+
+  SymbolIndex()
+    : sorted_(true), fingerprint_(hash::initial())
+  {
+  }
+
+  void add(const std::string& name)
+  {
+    names_.push_back(name);
+    sorted_ = false;
+  }
+
+  // Add the names bound at the top level of a parse tree.
+  void addDefinitions(const parser::ParseNode* pRoot)
+  {
+    ScopeAnalysis scopes(pRoot);
+
+    const std::vector<ScopeAnalysis::Binding>& bindings = scopes.bindings();
+    for (std::vector<ScopeAnalysis::Binding>::const_iterator it = bindings.begin();
+         it != bindings.end();
+         ++it)
+    {
+      if (it->scope == 0)
+        add(scopes.name(it->name));
+    }
+  }
+
+  // Sort and de-duplicate the names; this must be called after adding
+  // names, and before looking any up.
+  void finalize()
+  {
+    if (sorted_)
+      return;
+
+    std::sort(names_.begin(), names_.end());
+    names_.erase(std::unique(names_.begin(), names_.end()), names_.end());
+    std::vector<std::string>(names_).swap(names_);
+    sorted_ = true;
+
+    fingerprint_ = hash::initial();
+    for (index_type i = 0; i < size(); ++i)
+      fingerprint_ = hash::update(fingerprint_, names_[i]);
+  }
+
+  bool contains(const std::string& name) const
+  {
+    return std::binary_search(names_.begin(), names_.end(), name);
+  }
+
+  index_type size() const
+  {
+    return utils::size(names_);
+  }
+
+  // A hash of the names in the index, valid once it is finalized.
+  hash_type fingerprint() const
+  {
+    return fingerprint_;
+  }
+
+private:
+  std::vector<std::string> names_;
+  bool sorted_;
+  hash_type fingerprint_;
+};
+
+} // namespace diagnostics
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_DIAGNOSTICS_SYMBOL_INDEX_H */
@@ -2,7 +2,11 @@
 #define SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_H
 
 #include <sourcetools/diagnostics/Diagnostic.h>
+#include <sourcetools/diagnostics/ScopeAnalysis.h>
+#include <sourcetools/diagnostics/SymbolIndex.h>
 #include <sourcetools/diagnostics/Checkers.h>
 #include <sourcetools/diagnostics/DiagnosticsSet.h>
+#include <sourcetools/diagnostics/DiagnosticsSession.h>
+#include <sourcetools/diagnostics/NonStandardEvaluation.h>
 
 #endif /* SOURCETOOLS_DIAGNOSTICS_DIAGNOSTICS_H */
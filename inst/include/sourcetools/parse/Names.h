@@ -0,0 +1,50 @@
+#ifndef SOURCETOOLS_PARSE_NAMES_H
+#define SOURCETOOLS_PARSE_NAMES_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string>
+
+#include <sourcetools/parse/ParseNode.h>
+
+namespace sourcetools {
+namespace names {
+
+namespace detail {
+
+inline bool less(const char* lhs, const char* rhs)
+{
+  return std::strcmp(lhs, rhs) < 0;
+}
+
+} // namespace detail
+
+// Whether 'name' is in 'table', which must be sorted by 'strcmp()'.
+// Tables of constant strings are initialized before any code runs, so
+// they can be searched from any thread.
+template <std::size_t N>
+inline bool contains(const char* const (&table)[N], const char* name)
+{
+  return std::binary_search(table, table + N, name, detail::less);
+}
+
+// Whether a node names something: a symbol, or a string used in its
+// place (as in '"f" <- function() NULL').
+inline bool isName(const parser::ParseNode* pNode)
+{
+  const tokens::Token& token = pNode->token();
+  return token.isType(tokens::SYMBOL) || token.isType(tokens::STRING);
+}
+
+// The name a symbol or string stands for, without quotes or escapes.
+inline std::string value(const tokens::Token& token)
+{
+  // 'stringValue()' keeps its terminating null in the string.
+  return std::string(tokens::stringValue(token).c_str());
+}
+
+} // namespace names
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_PARSE_NAMES_H */
@@ -0,0 +1,775 @@
+#ifndef SOURCETOOLS_PARSE_PARSE_DATA_H
+#define SOURCETOOLS_PARSE_PARSE_DATA_H
+
+#include <vector>
+#include <algorithm>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/tokenization/tokenization.h>
+#include <sourcetools/parse/ParseNode.h>
+
+namespace sourcetools {
+namespace parser {
+
+// Name used for a token by R's own parser, as reported by
+// 'utils::getParseData()'.
+inline const char* parseDataTokenName(tokens::TokenType type)
+{
+  using namespace tokens;
+
+  switch (type)
+  {
+  case SYMBOL:                              return "SYMBOL";
+  case NUMBER:                              return "NUM_CONST";
+  case STRING:                              return "STR_CONST";
+  case COMMENT:                             return "COMMENT";
+  case COMMA:                               return "','";
+  case SEMI:                                return "';'";
+
+  case LPAREN:                              return "'('";
+  case RPAREN:                              return "')'";
+  case LBRACE:                              return "'{'";
+  case RBRACE:                              return "'}'";
+  case LBRACKET:                            return "'['";
+  case RBRACKET:                            return "']'";
+  case LDBRACKET:                           return "LBB";
+  case RDBRACKET:                           return "']'";
+
+  case OPERATOR_PLUS:                       return "'+'";
+  case OPERATOR_MINUS:                      return "'-'";
+  case OPERATOR_HELP:                       return "'?'";
+  case OPERATOR_NEGATION:                   return "'!'";
+  case OPERATOR_FORMULA:                    return "'~'";
+  case OPERATOR_NAMESPACE_EXPORTS:          return "NS_GET";
+  case OPERATOR_NAMESPACE_ALL:              return "NS_GET_INT";
+  case OPERATOR_DOLLAR:                     return "'$'";
+  case OPERATOR_AT:                         return "'@'";
+  case OPERATOR_HAT:                        return "'^'";
+  case OPERATOR_EXPONENTATION_STARS:        return "'^'";
+  case OPERATOR_SEQUENCE:                   return "':'";
+  case OPERATOR_MULTIPLY:                   return "'*'";
+  case OPERATOR_DIVIDE:                     return "'/'";
+  case OPERATOR_LESS:                       return "LT";
+  case OPERATOR_LESS_OR_EQUAL:              return "LE";
+  case OPERATOR_GREATER:                    return "GT";
+  case OPERATOR_GREATER_OR_EQUAL:           return "GE";
+  case OPERATOR_EQUAL:                      return "EQ";
+  case OPERATOR_NOT_EQUAL:                  return "NE";
+  case OPERATOR_AND_VECTOR:                 return "AND";
+  case OPERATOR_AND_SCALAR:                 return "AND2";
+  case OPERATOR_OR_VECTOR:                  return "OR";
+  case OPERATOR_OR_SCALAR:                  return "OR2";
+  case OPERATOR_ASSIGN_LEFT:                return "LEFT_ASSIGN";
+  case OPERATOR_ASSIGN_LEFT_PARENT:         return "LEFT_ASSIGN";
+  case OPERATOR_ASSIGN_LEFT_COLON:          return "LEFT_ASSIGN";
+  case OPERATOR_ASSIGN_RIGHT:               return "RIGHT_ASSIGN";
+  case OPERATOR_ASSIGN_RIGHT_PARENT:        return "RIGHT_ASSIGN";
+  case OPERATOR_ASSIGN_LEFT_EQUALS:         return "EQ_ASSIGN";
+  case OPERATOR_USER:                       return "SPECIAL";
+  case OPERATOR_PIPE:                       return "PIPE";
+  case OPERATOR_PIPE_BIND:                  return "PIPEBIND";
+
+  case KEYWORD_IF:                          return "IF";
+  case KEYWORD_ELSE:                        return "ELSE";
+  case KEYWORD_FOR:                         return "FOR";
+  case KEYWORD_IN:                          return "IN";
+  case KEYWORD_WHILE:                       return "WHILE";
+  case KEYWORD_REPEAT:                      return "REPEAT";
+  case KEYWORD_FUNCTION:                    return "FUNCTION";
+  case KEYWORD_NEXT:                        return "NEXT";
+  case KEYWORD_BREAK:                       return "BREAK";
+  case KEYWORD_NULL:                        return "NULL_CONST";
+  case KEYWORD_TRUE:
+  case KEYWORD_FALSE:
+  case KEYWORD_Inf:
+  case KEYWORD_NaN:
+  case KEYWORD_NA:
+  case KEYWORD_NA_integer_:
+  case KEYWORD_NA_real_:
+  case KEYWORD_NA_complex_:
+  case KEYWORD_NA_character_:               return "NUM_CONST";
+
+  default:                                  return "error";
+  }
+}
+
+// A table equivalent to that produced by 'utils::getParseData()': one
+// row per terminal token (including comments) and one row per
+// expression, each row holding the source range (1-based lines, and
+// columns as counted by R: in characters, with tab stops every 8
+// columns), the row's id and the id of its parent expression.
+//
+// Ids are assigned such that a node's children have smaller ids than
+// the node itself, as in R, but are not otherwise identical to the ids
+// R assigns. Rows are ordered as 'getParseData()' orders them.
+class ParseData
+{
+public:
+  typedef tokens::Token Token;
+  typedef tokens::TokenType TokenType;
+
+  ParseData(const ParseNode* pRoot, const char* code, index_type n)
+    : code_(code)
+  {
+    collectTerminals(n);
+
+    const std::vector<ParseNode*>& children = pRoot->children();
+    for (index_type i = 0, size = children.size(); i < size; ++i)
+      visit(children[i], -1, false);
+    walk();
+
+    assignOwners();
+    assignIds();
+    createRows();
+  }
+
+  index_type size() const { return utils::size(rows_); }
+
+  int line1(index_type i) const { return range(rows_[i]).line1; }
+  int col1(index_type i) const { return range(rows_[i]).col1; }
+  int line2(index_type i) const { return range(rows_[i]).line2; }
+  int col2(index_type i) const { return range(rows_[i]).col2; }
+
+  int id(index_type i) const { return row(i).id; }
+  int parent(index_type i) const { return row(i).parent; }
+  const char* token(index_type i) const { return row(i).name; }
+  bool terminal(index_type i) const { return rows_[i] < 0; }
+
+  // The text of a terminal token (empty for expressions).
+  const char* textBegin(index_type i) const
+  {
+    return terminal(i) ? code_ + terminals_[~rows_[i]].offset : code_;
+  }
+
+  index_type textSize(index_type i) const
+  {
+    return terminal(i) ? terminals_[~rows_[i]].size : 0;
+  }
+
+private:
+
+  struct Range
+  {
+    int line1, col1, line2, col2;
+  };
+
+  struct Node
+  {
+    const char* name;
+    index_type owner;      // entry index of the parent expression; -1 if none
+    int id;
+    int parent;
+  };
+
+  struct Terminal : Node
+  {
+    index_type offset;
+    index_type size;
+    TokenType type;
+    Range range;
+  };
+
+  struct Expression : Node
+  {
+    index_type begin;      // first terminal
+    index_type end;        // last terminal
+  };
+
+  // Tracks the R-style position of each byte in the buffer. Positions
+  // are requested in increasing order, so each byte is visited once.
+  class PositionCursor
+  {
+  public:
+    explicit PositionCursor(const char* code)
+      : code_(code), offset_(0), row_(1), column_(0)
+    {
+    }
+
+    void moveTo(index_type offset, int* pRow, int* pColumn)
+    {
+      for (; offset_ <= offset; ++offset_)
+      {
+        unsigned char ch = code_[offset_];
+        if (ch == '\n')
+        {
+          ++row_;
+          column_ = 0;
+          continue;
+        }
+
+        // UTF-8 continuation bytes don't start a new character.
+        if ((ch & 0xC0) != 0x80)
+          ++column_;
+
+        if (ch == '\t')
+          column_ = (column_ + 7) & ~7;
+      }
+
+      *pRow = row_;
+      *pColumn = column_;
+    }
+
+  private:
+    const char* code_;
+    index_type offset_;
+    int row_;
+    int column_;
+  };
+
+  // Row ordering used by 'getParseData()'.
+  class RowComparator
+  {
+  public:
+    explicit RowComparator(const ParseData& data) : data_(data) {}
+
+    bool operator()(index_type lhs, index_type rhs) const
+    {
+      const Range& a = data_.range(lhs);
+      const Range& b = data_.range(rhs);
+      if (a.line1 != b.line1) return a.line1 < b.line1;
+      if (a.col1 != b.col1)   return a.col1 < b.col1;
+      if (a.line2 != b.line2) return a.line2 > b.line2;
+      if (a.col2 != b.col2)   return a.col2 > b.col2;
+      return data_.node(lhs).id < data_.node(rhs).id;
+    }
+
+  private:
+    const ParseData& data_;
+  };
+
+  // Rows refer to terminals by their complement (i.e. negative
+  // indices), and to expressions directly.
+  const Node& node(index_type row) const
+  {
+    if (row < 0)
+      return terminals_[~row];
+    return expressions_[row];
+  }
+
+  const Node& row(index_type i) const
+  {
+    return node(rows_[i]);
+  }
+
+  Range range(index_type row) const
+  {
+    if (row < 0)
+      return terminals_[~row].range;
+
+    const Expression& expression = expressions_[row];
+    const Range& begin = terminals_[expression.begin].range;
+    const Range& end = terminals_[expression.end].range;
+    Range result = { begin.line1, begin.col1, end.line2, end.col2 };
+    return result;
+  }
+
+  void addTerminal(index_type offset, index_type size, TokenType type,
+                   PositionCursor* pCursor)
+  {
+    Terminal terminal;
+    terminal.name = parseDataTokenName(type);
+    terminal.owner = -1;
+    terminal.id = 0;
+    terminal.parent = 0;
+    terminal.offset = offset;
+    terminal.size = size;
+    terminal.type = type;
+    pCursor->moveTo(offset, &terminal.range.line1, &terminal.range.col1);
+    pCursor->moveTo(offset + size - 1, &terminal.range.line2, &terminal.range.col2);
+    terminals_.push_back(terminal);
+  }
+
+  void collectTerminals(index_type n)
+  {
+    if (n == 0)
+      return;
+
+    PositionCursor cursor(code_);
+    Token token;
+    tokenizer::Tokenizer tokenizer(code_, n);
+    while (tokenizer.tokenize(&token))
+    {
+      if (token.isType(tokens::WHITESPACE))
+        continue;
+
+      // R reads ']]' as two separate tokens.
+      if (token.isType(tokens::RDBRACKET))
+      {
+        addTerminal(token.offset(), 1, tokens::RBRACKET, &cursor);
+        addTerminal(token.offset() + 1, 1, tokens::RBRACKET, &cursor);
+        continue;
+      }
+
+      // Comment tokens include the line terminator; R's don't.
+      index_type size = token.size();
+      if (token.isType(tokens::COMMENT))
+        while (size > 0 && (token.begin()[size - 1] == '\n' || token.begin()[size - 1] == '\r'))
+          --size;
+
+      addTerminal(token.offset(), size, token.type(), &cursor);
+    }
+  }
+
+  // Find the terminal containing the byte at 'offset'.
+  index_type terminalAt(index_type offset) const
+  {
+    index_type lower = 0;
+    index_type upper = utils::size(terminals_);
+    while (upper - lower > 1)
+    {
+      index_type middle = lower + (upper - lower) / 2;
+      if (terminals_[middle].offset <= offset)
+        lower = middle;
+      else
+        upper = middle;
+    }
+    return lower;
+  }
+
+  static bool located(const Token& token)
+  {
+    return token.offset() != -1;
+  }
+
+  index_type addExpression(const char* name, index_type owner,
+                           index_type begin, index_type end)
+  {
+    Expression expression;
+    expression.name = name;
+    expression.owner = owner;
+    expression.id = 0;
+    expression.parent = 0;
+    expression.begin = begin;
+    expression.end = end;
+    expressions_.push_back(expression);
+    return utils::size(expressions_) - 1;
+  }
+
+  index_type addExpression(const ParseNode* pNode, index_type owner)
+  {
+    const Token& begin = pNode->begin();
+    const Token& end = pNode->end();
+    return addExpression(
+      "expr",
+      owner,
+      terminalAt(begin.offset()),
+      terminalAt(end.offset() + end.size() - 1));
+  }
+
+  // Make the terminal for 'token' a direct child of expression
+  // 'owner', optionally overriding its token name.
+  void own(const Token& token, index_type owner, const char* name = NULL)
+  {
+    if (!located(token))
+      return;
+
+    Terminal& terminal = terminals_[terminalAt(token.offset())];
+    terminal.owner = owner;
+    if (name != NULL)
+      terminal.name = name;
+  }
+
+  // The nearest non-comment terminal after / before 'index'.
+  index_type nextTerminal(index_type index) const
+  {
+    index_type n = utils::size(terminals_);
+    for (++index; index < n - 1; ++index)
+      if (terminals_[index].type != tokens::COMMENT)
+        break;
+    return index;
+  }
+
+  index_type previousTerminal(index_type index) const
+  {
+    for (--index; index > 0; --index)
+      if (terminals_[index].type != tokens::COMMENT)
+        break;
+    return index;
+  }
+
+  static bool isFunctionCall(const ParseNode* pNode)
+  {
+    const Token& token = pNode->token();
+    if (token.isType(tokens::LBRACKET) || token.isType(tokens::LDBRACKET))
+      return true;
+    return token.isType(tokens::LPAREN) && pNode->children().size() > 1;
+  }
+
+  static bool isLeaf(const ParseNode* pNode)
+  {
+    return pNode->children().empty() && located(pNode->token());
+  }
+
+  static bool isPlaceholder(const ParseNode* pNode)
+  {
+    const Token& token = pNode->token();
+    return
+      token.isType(tokens::EMPTY) ||
+      token.isType(tokens::MISSING) ||
+      token.isType(tokens::END);
+  }
+
+  static const char* symbolName(const Token& token, const char* name)
+  {
+    return token.isType(tokens::SYMBOL) ? name : NULL;
+  }
+
+  void visitFunctionCall(const ParseNode* pNode, index_type owner)
+  {
+    using namespace tokens;
+
+    const std::vector<ParseNode*>& children = pNode->children();
+    visit(children[0], owner, pNode->token().isType(LPAREN));
+
+    for (index_type i = 1, n = children.size(); i < n; ++i)
+    {
+      const ParseNode* pChild = children[i];
+      const Token& token = pChild->token();
+      if (token.isType(OPERATOR_ASSIGN_LEFT_EQUALS) && pChild->children().size() == 2)
+      {
+        const ParseNode* pLhs = pChild->children()[0];
+        const ParseNode* pRhs = pChild->children()[1];
+        ownLater(pLhs->token(), owner, symbolName(pLhs->token(), "SYMBOL_SUB"));
+        ownLater(token, owner, "EQ_SUB");
+        visit(pRhs, owner, false);
+      }
+      else
+      {
+        visit(pChild, owner, false);
+      }
+    }
+  }
+
+  void visitFunctionDefinition(const ParseNode* pNode, index_type owner)
+  {
+    using namespace tokens;
+
+    const std::vector<ParseNode*>& children = pNode->children();
+    if (children.size() != 2)
+    {
+      for (index_type i = 0, n = children.size(); i < n; ++i)
+        visit(children[i], owner, false);
+      return;
+    }
+
+    const std::vector<ParseNode*>& formals = children[0]->children();
+    for (index_type i = 0, n = formals.size(); i < n; ++i)
+    {
+      const ParseNode* pFormal = formals[i];
+      const Token& token = pFormal->token();
+      if (token.isType(OPERATOR_ASSIGN_LEFT_EQUALS) && pFormal->children().size() == 2)
+      {
+        ownLater(pFormal->children()[0]->token(), owner, "SYMBOL_FORMALS");
+        ownLater(token, owner, "EQ_FORMALS");
+        visit(pFormal->children()[1], owner, false);
+      }
+      else
+      {
+        ownLater(token, owner, "SYMBOL_FORMALS");
+      }
+    }
+
+    visit(children[1], owner, false);
+  }
+
+  void visitFor(const ParseNode* pNode, index_type owner)
+  {
+    const std::vector<ParseNode*>& children = pNode->children();
+    if (children.size() != 3 || !located(children[2]->begin()))
+    {
+      for (index_type i = 0, n = children.size(); i < n; ++i)
+        visit(children[i], owner, false);
+      return;
+    }
+
+    // R groups '(<symbol> in <expr>)' into a 'forcond' node.
+    index_type keyword = terminalAt(pNode->token().offset());
+    index_type body = terminalAt(children[2]->begin().offset());
+    index_type condition = addExpression(
+      "forcond",
+      owner,
+      nextTerminal(keyword),
+      previousTerminal(body));
+
+    ownLater(children[0]->token(), condition);
+    visit(children[1], condition, false);
+    visit(children[2], owner, false);
+  }
+
+  // Operators whose right-hand side is a name, rather than an
+  // expression: '::', ':::', '$' and '@'.
+  void visitAccessor(const ParseNode* pNode, index_type owner, bool isCallHead)
+  {
+    using namespace tokens;
+
+    const Token& token = pNode->token();
+    const ParseNode* pLhs = pNode->children()[0];
+    const ParseNode* pRhs = pNode->children()[1];
+
+    bool isNamespace =
+      token.isType(OPERATOR_NAMESPACE_EXPORTS) ||
+      token.isType(OPERATOR_NAMESPACE_ALL);
+
+    if (isNamespace && isLeaf(pLhs))
+      ownLater(pLhs->token(), owner, symbolName(pLhs->token(), "SYMBOL_PACKAGE"));
+    else
+      visit(pLhs, owner, false);
+
+    if (!isLeaf(pRhs))
+    {
+      visit(pRhs, owner, false);
+      return;
+    }
+
+    const char* name = "SYMBOL";
+    if (token.isType(OPERATOR_AT))
+      name = "SLOT";
+    else if (isCallHead)
+      name = "SYMBOL_FUNCTION_CALL";
+    ownLater(pRhs->token(), owner, symbolName(pRhs->token(), name));
+  }
+
+  // The tree is walked with an explicit stack of tasks, so that deeply
+  // nested code cannot overflow the C stack. Processing a node schedules
+  // its children (and the tokens it owns) in the order a recursive walk
+  // would visit them, and that order is kept by pushing them onto the
+  // stack in reverse; expressions are thus created in pre-order.
+  struct Task
+  {
+    const ParseNode* pNode;  // the node to visit, or NULL to own a token
+    const Token* pToken;
+    index_type owner;
+    bool isCallHead;
+    const char* name;
+  };
+
+  void visit(const ParseNode* pNode, index_type owner, bool isCallHead)
+  {
+    if (pNode == NULL)
+      return;
+
+    Task task = { pNode, NULL, owner, isCallHead, NULL };
+    pending_.push_back(task);
+  }
+
+  void ownLater(const Token& token, index_type owner, const char* name = NULL)
+  {
+    Task task = { NULL, &token, owner, false, name };
+    pending_.push_back(task);
+  }
+
+  void walk()
+  {
+    std::vector<Task> stack;
+    stack.insert(stack.end(), pending_.rbegin(), pending_.rend());
+    pending_.clear();
+
+    while (!stack.empty())
+    {
+      Task task = stack.back();
+      stack.pop_back();
+
+      if (task.pNode == NULL)
+        own(*task.pToken, task.owner, task.name);
+      else
+        process(task.pNode, task.owner, task.isCallHead);
+
+      stack.insert(stack.end(), pending_.rbegin(), pending_.rend());
+      pending_.clear();
+    }
+  }
+
+  void process(const ParseNode* pNode, index_type owner, bool isCallHead)
+  {
+    using namespace tokens;
+
+    const Token& token = pNode->token();
+    const std::vector<ParseNode*>& children = pNode->children();
+
+    if (isPlaceholder(pNode) || !located(pNode->begin()))
+    {
+      for (index_type i = 0, n = children.size(); i < n; ++i)
+        visit(children[i], owner, false);
+      return;
+    }
+
+    index_type expression = addExpression(pNode, owner);
+
+    if (isLeaf(pNode))
+    {
+      const char* name = isCallHead ? "SYMBOL_FUNCTION_CALL" : "SYMBOL";
+      own(token, expression, symbolName(token, name));
+      return;
+    }
+
+    own(token, expression);
+
+    if (isFunctionCall(pNode))
+      visitFunctionCall(pNode, expression);
+    else if (token.isType(KEYWORD_FUNCTION))
+      visitFunctionDefinition(pNode, expression);
+    else if (token.isType(KEYWORD_FOR))
+      visitFor(pNode, expression);
+    else if (children.size() == 2 && (
+               token.isType(OPERATOR_NAMESPACE_EXPORTS) ||
+               token.isType(OPERATOR_NAMESPACE_ALL) ||
+               token.isType(OPERATOR_DOLLAR) ||
+               token.isType(OPERATOR_AT)))
+      visitAccessor(pNode, expression, isCallHead);
+    else
+      for (index_type i = 0, n = children.size(); i < n; ++i)
+        visit(children[i], expression, false);
+  }
+
+  // Terminals not claimed by any expression while walking the tree
+  // (closing brackets, commas, 'else', comments, ...) belong to the
+  // innermost expression spanning them.
+  void assignOwners()
+  {
+    index_type n = utils::size(expressions_);
+    std::vector<index_type> order(n);
+    for (index_type i = 0; i < n; ++i)
+      order[i] = i;
+    std::stable_sort(order.begin(), order.end(), ExpressionComparator(*this));
+
+    std::vector<index_type> stack;
+    index_type next = 0;
+    for (index_type i = 0, size = terminals_.size(); i < size; ++i)
+    {
+      while (next < n && expressions_[order[next]].begin <= i)
+      {
+        while (!stack.empty() && expressions_[stack.back()].end < expressions_[order[next]].begin)
+          stack.pop_back();
+        stack.push_back(order[next++]);
+      }
+
+      while (!stack.empty() && expressions_[stack.back()].end < i)
+        stack.pop_back();
+
+      Terminal& terminal = terminals_[i];
+      if (terminal.owner == -1 && !stack.empty())
+        terminal.owner = stack.back();
+    }
+  }
+
+  class ExpressionComparator
+  {
+  public:
+    explicit ExpressionComparator(const ParseData& data) : data_(data) {}
+
+    bool operator()(index_type lhs, index_type rhs) const
+    {
+      const Expression& a = data_.expressions_[lhs];
+      const Expression& b = data_.expressions_[rhs];
+      if (a.begin != b.begin)
+        return a.begin < b.begin;
+      return a.end > b.end;
+    }
+
+  private:
+    const ParseData& data_;
+  };
+
+  // Number nodes bottom-up, so that children come before their parents
+  // (as they do in R, where ids are assigned as the parser reduces).
+  void assignIds()
+  {
+    index_type n = utils::size(expressions_);
+
+    // Depth and top-level ancestor of each expression; owners are
+    // always created before the expressions they own.
+    std::vector<index_type> depths(n, 0);
+    std::vector<index_type> roots(n);
+    for (index_type i = 0; i < n; ++i)
+    {
+      index_type owner = expressions_[i].owner;
+      roots[i] = owner == -1 ? i : roots[owner];
+      if (owner != -1)
+        depths[i] = depths[owner] + 1;
+    }
+
+    std::vector<index_type> order;
+    order.reserve(n + terminals_.size());
+    for (index_type i = 0, size = terminals_.size(); i < size; ++i)
+      order.push_back(~i);
+    for (index_type i = 0; i < n; ++i)
+      order.push_back(i);
+
+    std::stable_sort(order.begin(), order.end(), DepthComparator(depths));
+
+    for (index_type i = 0, size = order.size(); i < size; ++i)
+      mutableNode(order[i]).id = i + 1;
+
+    for (index_type i = 0, size = order.size(); i < size; ++i)
+    {
+      Node& node = mutableNode(order[i]);
+      if (node.owner != -1)
+        node.parent = expressions_[node.owner].id;
+    }
+
+    // Top-level comments refer to the next top-level expression, with
+    // a negated id.
+    index_type next = -1;
+    for (index_type i = utils::size(terminals_) - 1; i >= 0; --i)
+    {
+      Terminal& terminal = terminals_[i];
+      if (terminal.owner != -1)
+      {
+        next = roots[terminal.owner];
+      }
+      else if (terminal.type == tokens::COMMENT && next != -1)
+      {
+        terminal.parent = -expressions_[next].id;
+      }
+    }
+  }
+
+  // Orders terminals before expressions, and deeper expressions before
+  // shallower ones.
+  class DepthComparator
+  {
+  public:
+    explicit DepthComparator(const std::vector<index_type>& depths)
+      : depths_(depths)
+    {
+    }
+
+    bool operator()(index_type lhs, index_type rhs) const
+    {
+      if (lhs < 0 || rhs < 0)
+        return lhs < 0 && rhs >= 0;
+      return depths_[lhs] > depths_[rhs];
+    }
+
+  private:
+    const std::vector<index_type>& depths_;
+  };
+
+  Node& mutableNode(index_type row)
+  {
+    if (row < 0)
+      return terminals_[~row];
+    return expressions_[row];
+  }
+
+  void createRows()
+  {
+    rows_.reserve(terminals_.size() + expressions_.size());
+    for (index_type i = 0, n = terminals_.size(); i < n; ++i)
+      rows_.push_back(~i);
+    for (index_type i = 0, n = expressions_.size(); i < n; ++i)
+      rows_.push_back(i);
+    std::sort(rows_.begin(), rows_.end(), RowComparator(*this));
+  }
+
+  const char* code_;
+  std::vector<Terminal> terminals_;
+  std::vector<Expression> expressions_;
+  std::vector<index_type> rows_;
+  std::vector<Task> pending_;
+};
+
+} // namespace parser
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_PARSE_PARSE_DATA_H */
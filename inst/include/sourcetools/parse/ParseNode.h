@@ -3,6 +3,7 @@
 
 #include <map>
 #include <memory>
+#include <algorithm>
 
 #include <sourcetools/collection/collection.h>
 #include <sourcetools/tokenization/tokenization.h>
@@ -41,21 +42,23 @@ public:
 
   static ParseNode* create(const TokenType& type)
   {
-    static std::map<TokenType, Token> tokens;
-    if (!tokens.count(type))
-      tokens[type] = Token(type);
-
-    const Token& token = tokens[type];
-    return new ParseNode(token);
+    return new ParseNode(Token(type));
   }
 
   ~ParseNode()
   {
-    for (std::vector<ParseNode*>::const_iterator it = children_.begin();
-         it != children_.end();
-         ++it)
+    // Free descendants iteratively, so that deeply nested trees cannot
+    // overflow the stack: each node is detached from its children
+    // before it is deleted.
+    std::vector<ParseNode*> nodes;
+    nodes.swap(children_);
+    while (!nodes.empty())
     {
-      delete *it;
+      ParseNode* pNode = nodes.back();
+      nodes.pop_back();
+      nodes.insert(nodes.end(), pNode->children_.begin(), pNode->children_.end());
+      pNode->children_.clear();
+      delete pNode;
     }
   }
 
@@ -88,6 +91,56 @@ public:
     children_.push_back(pNode);
   }
 
+  // Add a child without widening the range of this node or its
+  // ancestors. Trees built this way must call 'updateRanges()' on the
+  // root once complete; this avoids walking the parent chain on every
+  // insertion, which is quadratic for deeply nested code.
+  void append(ParseNode* pNode)
+  {
+    if (pNode->parent_ != NULL)
+      pNode->parent_->remove(pNode);
+    pNode->parent_ = this;
+    children_.push_back(pNode);
+  }
+
+  // Compute the range of every node in this tree from its token, any
+  // explicitly set end, and the ranges of its children.
+  void updateRanges()
+  {
+    // Visit nodes in reverse pre-order, so that children are always
+    // complete before their parent.
+    std::vector<ParseNode*> nodes;
+    std::vector<ParseNode*> stack(1, this);
+    while (!stack.empty())
+    {
+      ParseNode* pNode = stack.back();
+      stack.pop_back();
+      nodes.push_back(pNode);
+      stack.insert(stack.end(), pNode->children_.begin(), pNode->children_.end());
+    }
+
+    for (std::vector<ParseNode*>::reverse_iterator it = nodes.rbegin();
+         it != nodes.rend();
+         ++it)
+    {
+      ParseNode* pNode = *it;
+      for (std::vector<ParseNode*>::const_iterator child = pNode->children_.begin();
+           child != pNode->children_.end();
+           ++child)
+      {
+        const Token& begin = (*child)->begin();
+        const Token& end   = (*child)->end();
+        if (begin.offset() == -1 || end.offset() == -1)
+          continue;
+
+        if (begin.begin() < pNode->begin_.begin())
+          pNode->begin_ = begin;
+        if (end.end() > pNode->end_.end())
+          pNode->end_ = end;
+      }
+    }
+  }
+
   const Token& begin() const
   {
     return begin_;
@@ -100,6 +153,12 @@ public:
         pNode->begin_ = begin;
   }
 
+  // Set the beginning of this node only; see 'append()'.
+  void setLocalBegin(const Token& begin)
+  {
+    begin_ = begin;
+  }
+
   const Token& end() const
   {
     return end_;
@@ -113,6 +172,12 @@ public:
         pNode->end_ = end;
   }
 
+  // Set the end of this node only; see 'append()'.
+  void setLocalEnd(const Token& end)
+  {
+    end_ = end;
+  }
+
   void bounds(const char** begin, const char** end)
   {
     *begin = begin_.begin();
@@ -0,0 +1,46 @@
+#ifndef SOURCETOOLS_PARSE_PARSE_OPTIONS_H
+#define SOURCETOOLS_PARSE_PARSE_OPTIONS_H
+
+namespace sourcetools {
+namespace parser {
+
+struct ParseOptions
+{
+  ParseOptions()
+    : buildTree(true),
+      recordLocations(false),
+      deferRanges(false),
+      maxDepth(100000)
+  {
+  }
+
+  // When false, the parser runs the full grammar and records errors in
+  // the ParseStatus, but creates no parse nodes; 'Parser::parse()' then
+  // returns NULL. Use this when only syntax errors are of interest.
+  bool buildTree;
+
+  // When true, the location of each node is recorded in the ParseStatus,
+  // enabling 'ParseStatus::getNodeAtPosition()' and related queries.
+  bool recordLocations;
+
+  // When true, node ranges are computed in a single pass once the tree
+  // is complete, rather than propagated to ancestors as each child is
+  // added. The ranges are the same for valid code; for incomplete code,
+  // a node's range is never shrunk by a missing closing token. Since
+  // the parser attaches subtrees only once they are complete, eager
+  // propagation rarely walks past the immediate parent, and is the
+  // default.
+  bool deferRanges;
+
+  // The maximum nesting depth of parentheses, braces, calls and control
+  // flow constructs; deeper code is reported as an error. The parser
+  // itself uses no C stack for nesting, but R's evaluator and deparser
+  // recurse on the objects built from the tree, so the depth is bounded
+  // nonetheless. Operator chains do not count towards the depth.
+  int maxDepth;
+};
+
+} // namespace parser
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_PARSE_PARSE_OPTIONS_H */
@@ -1,31 +1,74 @@
 #ifndef SOURCETOOLS_PARSE_PARSE_STATUS_H
 #define SOURCETOOLS_PARSE_PARSE_STATUS_H
 
+#include <vector>
+#include <utility>
+#include <algorithm>
+
 #include <sourcetools/collection/Position.h>
+#include <sourcetools/collection/Range.h>
 
 #include <sourcetools/parse/ParseError.h>
+#include <sourcetools/parse/ParseNode.h>
 
 namespace sourcetools {
 namespace parser {
 
-class ParseNode;
-
 class ParseStatus
 {
   typedef collections::Position Position;
+  typedef collections::Range Range;
+  typedef std::pair<Position, ParseNode*> Location;
 
 public:
-  ParseStatus() {}
+  ParseStatus() : sorted_(true) {}
 
+  // Node locations are only recorded when parsing with
+  // 'ParseOptions::recordLocations' set. The parser creates nodes in
+  // source order, so this is normally just an append.
   void recordNodeLocation(const Position& position,
                           ParseNode* pNode)
   {
-    map_[position] = pNode;
+    if (!locations_.empty() && position < locations_.back().first)
+      sorted_ = false;
+    locations_.push_back(Location(position, pNode));
   }
 
+  // Get the node whose token starts at 'position', or NULL if there is
+  // no such node. If several nodes were recorded at the same position,
+  // the most recently created one is returned.
   ParseNode* getNodeAtPosition(const Position& position)
   {
-    return map_[position];
+    std::vector<Location>::const_iterator it = upperBound(position);
+    if (it == locations_.begin())
+      return NULL;
+
+    --it;
+    return it->first == position ? it->second : NULL;
+  }
+
+  // Get the smallest node whose range contains [begin, end), or NULL
+  // if no recorded node encloses that range.
+  const ParseNode* getSmallestEnclosingNode(const Position& begin,
+                                            const Position& end)
+  {
+    std::vector<Location>::const_iterator it = upperBound(begin);
+    if (it == locations_.begin())
+      return NULL;
+
+    // Any node enclosing the range contains the last token starting at
+    // or before 'begin', so the answer is that token's node or one of
+    // its ancestors.
+    for (const ParseNode* pNode = (--it)->second;
+         pNode != NULL;
+         pNode = pNode->parent())
+    {
+      Range range = pNode->range();
+      if (range.start() <= begin && end <= range.end())
+        return pNode;
+    }
+
+    return NULL;
   }
 
   void addError(const ParseError& error)
@@ -39,7 +82,28 @@ public:
   }
 
 private:
-  std::map<Position, ParseNode*> map_;
+
+  static bool compare(const Location& lhs, const Location& rhs)
+  {
+    return lhs.first < rhs.first;
+  }
+
+  std::vector<Location>::const_iterator upperBound(const Position& position)
+  {
+    if (!sorted_)
+    {
+      std::stable_sort(locations_.begin(), locations_.end(), compare);
+      sorted_ = true;
+    }
+
+    return std::upper_bound(
+      locations_.begin(), locations_.end(),
+      Location(position, static_cast<ParseNode*>(NULL)),
+      compare);
+  }
+
+  std::vector<Location> locations_;
+  bool sorted_;
   std::vector<ParseError> errors_;
 };
 } // namespace parser
@@ -12,6 +12,7 @@
 #include <sourcetools/parse/Precedence.h>
 #include <sourcetools/parse/ParseError.h>
 #include <sourcetools/parse/ParseStatus.h>
+#include <sourcetools/parse/ParseOptions.h>
 
 // Defines that will go away once the parser is more tested / game ready
 // #define SOURCE_TOOLS_DEBUG_PARSER_TRACE
@@ -63,18 +64,96 @@ class Parser
   Token previous_;
   ParseState state_;
   ParseStatus* pStatus_;
+  ParseOptions options_;
+
+  // Operators awaiting their right-hand operand; see 'parseExpression()'.
+  struct PendingOperator
+  {
+    PendingOperator(ParseNode* pNode, int precedence)
+      : pNode(pNode), precedence(precedence)
+    {
+    }
+
+    ParseNode* pNode;
+    int precedence;
+  };
+
+  // Constructs awaiting a nested expression, and the step each resumes
+  // at; see 'resume()'.
+  enum Step
+  {
+    STEP_EXPRESSION_OPERAND,
+    STEP_EXPRESSION_CONTINUATION,
+    STEP_CALL_ARGUMENT,
+    STEP_CALL_NAMED_ARGUMENT,
+    STEP_CALL_ARGUMENT_DONE,
+    STEP_CALL_CLOSE,
+    STEP_FUNCTION_ARGUMENT,
+    STEP_FUNCTION_ARGUMENT_DONE,
+    STEP_FUNCTION_BODY,
+    STEP_IF_CONDITION,
+    STEP_IF_BODY,
+    STEP_LOOP_CONDITION,
+    STEP_BRACE_STATEMENT,
+    STEP_BRACE_STATEMENT_DONE,
+    STEP_PAREN_BODY,
+    STEP_LAST_CHILD
+  };
+
+  struct Frame
+  {
+    Frame(Step step, ParseNode* pNode, ParseState state)
+      : step(step),
+        pNode(pNode),
+        pPending(NULL),
+        state(state),
+        base(0),
+        precedence(0),
+        rhsType(tokens::EMPTY)
+    {
+    }
+
+    Step step;
+    ParseNode* pNode;       // the node being built
+    ParseNode* pPending;    // an argument list or named argument being built
+    ParseState state;       // the state to restore on leaving the construct
+    std::size_t base;       // expressions: size of 'operators_' on entry
+    int precedence;         // expressions: minimum continuation precedence
+    TokenType rhsType;      // calls: the closing bracket
+  };
+
+  std::vector<PendingOperator> operators_;
+  std::vector<Frame> frames_;
+  ParseNode* value_;
+  int depth_;
+  bool aborted_;
+
+  // Stands in for every node when not building a tree.
+  ParseNode placeholder_;
 
 public:
-  explicit Parser(const std::string& code)
+  explicit Parser(const std::string& code,
+                  const ParseOptions& options = ParseOptions())
     : tokenizer_(code.c_str(), code.size()),
-      state_(PARSE_STATE_TOP_LEVEL)
+      state_(PARSE_STATE_TOP_LEVEL),
+      options_(options),
+      value_(NULL),
+      depth_(0),
+      aborted_(false),
+      placeholder_(Token(tokens::EMPTY))
   {
     advance();
   }
 
-  explicit Parser(const char* code, index_type n)
+  explicit Parser(const char* code, index_type n,
+                  const ParseOptions& options = ParseOptions())
     : tokenizer_(code, n),
-      state_(PARSE_STATE_TOP_LEVEL)
+      state_(PARSE_STATE_TOP_LEVEL),
+      options_(options),
+      value_(NULL),
+      depth_(0),
+      aborted_(false),
+      placeholder_(Token(tokens::EMPTY))
   {
     advance();
   }
@@ -83,10 +162,18 @@ private:
 
   // Error-related ----
 
+  void addError(const ParseError& error)
+  {
+    // Once parsing has been abandoned, the errors reported while
+    // unwinding are only noise.
+    if (!aborted_)
+      pStatus_->addError(error);
+  }
+
   void unexpectedEndOfInput()
   {
     ParseError error("unexpected end of input");
-    pStatus_->addError(error);
+    addError(error);
   }
 
   std::string unexpectedTokenString(const Token& token)
@@ -117,7 +204,7 @@ private:
                        const std::string& message)
   {
     ParseError error(token, message);
-    pStatus_->addError(error);
+    addError(error);
   }
 
   bool checkUnexpectedEnd(const Token& token)
@@ -125,150 +212,249 @@ private:
     if (UNLIKELY(token.isType(tokens::END)))
     {
       ParseError error(token, "unexpected end of input");
-      pStatus_->addError(error);
+      addError(error);
       return true;
     }
 
     return false;
   }
 
+  ParseNode* maximumDepthExceeded()
+  {
+    unexpectedToken(current(), "maximum nesting depth exceeded");
+
+    // Abandon the parse: skip the remaining input, so that the enclosing
+    // constructs unwind without recursing any further.
+    aborted_ = true;
+    while (!current().isType(tokens::END))
+      advance();
+
+    return createNode(tokens::INVALID);
+  }
+
   // Parser sub-routines ----
+  //
+  // Nested constructs are parsed without recursion. The constructs being
+  // parsed are kept on an explicit stack of frames, and a sub-routine
+  // needing a nested expression records in its frame the step to resume
+  // at, then starts the nested expression. That either pushes a frame of
+  // its own, or completes at once; either way, the result is handed back
+  // in 'value_' when the sub-routine's frame is resumed. The sub-routines
+  // otherwise follow the grammar as a recursive descent parser would.
+
+  void enter(Step step, ParseNode* pNode)
+  {
+    frames_.push_back(Frame(step, pNode, state_));
+  }
+
+  // Complete the innermost construct, with 'pNode' as its result.
+  void leave(ParseNode* pNode)
+  {
+    frames_.pop_back();
+    value_ = pNode;
+  }
+
+  void resume()
+  {
+    switch (frames_.back().step)
+    {
+    case STEP_EXPRESSION_OPERAND:      return parseOperand();
+    case STEP_EXPRESSION_CONTINUATION: return parseExpressionContinuation();
+    case STEP_CALL_ARGUMENT:           return parseFunctionCallOne();
+    case STEP_CALL_NAMED_ARGUMENT:     return parseFunctionCallNamedArgument();
+    case STEP_CALL_ARGUMENT_DONE:      return parseFunctionCallArgumentDone();
+    case STEP_CALL_CLOSE:              return closeFunctionCall();
+    case STEP_FUNCTION_ARGUMENT:       return parseFunctionArgumentListOne();
+    case STEP_FUNCTION_ARGUMENT_DONE:  return parseFunctionArgumentDone();
+    case STEP_FUNCTION_BODY:           return parseFunctionBody();
+    case STEP_IF_CONDITION:            return parseIfCondition();
+    case STEP_IF_BODY:                 return parseIfBody();
+    case STEP_LOOP_CONDITION:          return parseLoopCondition();
+    case STEP_BRACE_STATEMENT:         return parseBracedStatement();
+    case STEP_BRACE_STATEMENT_DONE:    return parseBracedStatementDone();
+    case STEP_PAREN_BODY:              return parseParentheticalBody();
+    case STEP_LAST_CHILD:              return parseLastChild();
+    }
+  }
+
+  // A node's last child is complete; so is the node.
+  void parseLastChild()
+  {
+    ParseNode* pNode = frames_.back().pNode;
+    add(pNode, value_);
+    leave(pNode);
+  }
 
-  ParseNode* parseFunctionArgumentListOne()
+  void parseFunctionArgumentListOne()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFunctionArgument()");
     using namespace tokens;
 
+    Frame& frame = frames_.back();
+    if (checkUnexpectedEnd(current()))
+    {
+      frame.step = STEP_FUNCTION_BODY;
+      return;
+    }
+
+    frame.step = STEP_FUNCTION_ARGUMENT_DONE;
     check(SYMBOL);
 
     Token lookahead = peek(1);
     if (lookahead.isType(COMMA) || lookahead.isType(RPAREN))
-      return ParseNode::create(consume());
+    {
+      value_ = createNode(consume());
+      return;
+    }
     else if (lookahead.isType(OPERATOR_ASSIGN_LEFT_EQUALS))
       return parseExpression();
 
     if (isOperator(lookahead))
       unexpectedToken(lookahead, "expected '=', ',' or ')' following argument name");
 
-    return parseExpression();
+    parseExpression();
   }
 
-  ParseNode* parseFunctionArgumentList()
+  void parseFunctionArgumentDone()
   {
-    SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFunctionArgumentList()");
     using namespace tokens;
 
-    ParseNode* pNode = createNode(EMPTY);
-    if (token_.isType(RPAREN))
-      return pNode;
-
-    while (true)
+    Frame& frame = frames_.back();
+    add(frame.pPending, value_);
+    if (current().isType(RPAREN))
     {
-      if (checkUnexpectedEnd(current()))
-        break;
-
-      pNode->add(parseFunctionArgumentListOne());
-      if (current().isType(RPAREN))
-        return pNode;
-      else if (current().isType(COMMA))
-      {
-        advance();
-        continue;
-      }
-
-      // TODO: how should we recover here? For now, we
-      // assume that there should have been a comma and
-      // continue parsing.
-      unexpectedToken(current(), "expected ',' or ')'");
-      continue;
+      frame.step = STEP_FUNCTION_BODY;
+      return;
+    }
+    else if (current().isType(COMMA))
+    {
+      advance();
+      frame.step = STEP_FUNCTION_ARGUMENT;
+      return;
     }
 
-    return pNode;
+    // TODO: how should we recover here? For now, we
+    // assume that there should have been a comma and
+    // continue parsing.
+    unexpectedToken(current(), "expected ',' or ')'");
+    frame.step = STEP_FUNCTION_ARGUMENT;
   }
 
-  ParseNode* parseFunctionDefinition()
+  void parseFunctionDefinition()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFunctionDefinition()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(KEYWORD_FUNCTION);
     checkAndAdvance(LPAREN, false);
-    ParseState state = state_;
+    enter(STEP_FUNCTION_ARGUMENT, pNode);
     state_ = PARSE_STATE_PAREN;
-    pNode->add(parseFunctionArgumentList());
-    state_ = state;
+
+    SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFunctionArgumentList()");
+    Frame& frame = frames_.back();
+    frame.pPending = createNode(EMPTY);
+    if (token_.isType(RPAREN))
+      frame.step = STEP_FUNCTION_BODY;
+  }
+
+  void parseFunctionBody()
+  {
+    using namespace tokens;
+    Frame& frame = frames_.back();
+    add(frame.pNode, frame.pPending);
+    state_ = frame.state;
     checkAndAdvance(RPAREN, false);
-    pNode->add(parseNonEmptyExpression());
-    return pNode;
+    frame.step = STEP_LAST_CHILD;
+    parseNonEmptyExpression();
   }
 
-  ParseNode* parseFor()
+  void parseFor()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFor()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(KEYWORD_FOR);
     checkAndAdvance(LPAREN, false);
-    ParseState state = state_;
+    enter(STEP_LOOP_CONDITION, pNode);
     state_ = PARSE_STATE_PAREN;
     check(SYMBOL);
-    pNode->add(createNode(consume()));
+    add(pNode, createNode(consume()));
     checkAndAdvance(KEYWORD_IN, false);
-    pNode->add(parseNonEmptyExpression());
-    state_ = state;
-    checkAndAdvance(RPAREN, false);
-    pNode->add(parseNonEmptyExpression());
-    return pNode;
+    parseNonEmptyExpression();
   }
 
-  ParseNode* parseIf()
+  void parseIf()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseIf()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(KEYWORD_IF);
     checkAndAdvance(LPAREN, false);
-    ParseState state = state_;
+    enter(STEP_IF_CONDITION, pNode);
     state_ = PARSE_STATE_PAREN;
-    pNode->add(parseNonEmptyExpression());
-    state_ = state;
+    parseNonEmptyExpression();
+  }
+
+  void parseIfCondition()
+  {
+    using namespace tokens;
+    Frame& frame = frames_.back();
+    add(frame.pNode, value_);
+    state_ = frame.state;
     checkAndAdvance(RPAREN, false);
-    pNode->add(parseNonEmptyExpression());
-    if (current().isType(KEYWORD_ELSE))
-    {
-      advance();
-      pNode->add(parseNonEmptyExpression());
-    }
-    return pNode;
+    frame.step = STEP_IF_BODY;
+    parseNonEmptyExpression();
+  }
+
+  void parseIfBody()
+  {
+    using namespace tokens;
+    Frame& frame = frames_.back();
+    add(frame.pNode, value_);
+    if (!current().isType(KEYWORD_ELSE))
+      return leave(frame.pNode);
+
+    advance();
+    frame.step = STEP_LAST_CHILD;
+    parseNonEmptyExpression();
   }
 
-  ParseNode* parseWhile()
+  void parseWhile()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseWhile()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(KEYWORD_WHILE);
     checkAndAdvance(LPAREN, false);
-    ParseState state = state_;
+    enter(STEP_LOOP_CONDITION, pNode);
     state_ = PARSE_STATE_PAREN;
-    pNode->add(parseNonEmptyExpression());
-    state_ = state;
+    parseNonEmptyExpression();
+  }
+
+  // The parenthesized part of a 'for' or 'while' loop is complete; parse
+  // the body.
+  void parseLoopCondition()
+  {
+    using namespace tokens;
+    Frame& frame = frames_.back();
+    add(frame.pNode, value_);
+    state_ = frame.state;
     checkAndAdvance(RPAREN, false);
-    pNode->add(parseNonEmptyExpression());
-    return pNode;
+    frame.step = STEP_LAST_CHILD;
+    parseNonEmptyExpression();
   }
 
-  ParseNode* parseRepeat()
+  void parseRepeat()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseRepeat()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(KEYWORD_REPEAT);
-    pNode->add(parseNonEmptyExpression());
-    return pNode;
+    enter(STEP_LAST_CHILD, pNode);
+    parseNonEmptyExpression();
   }
 
-  ParseNode* parseControlFlowKeyword()
+  void parseControlFlowKeyword()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseControlFlowKeyword('" << token_.contents() << "')");
     using namespace tokens;
@@ -286,67 +472,90 @@ private:
       return parseRepeat();
 
     unexpectedToken(consume(), "expected control-flow keyword");
-    return createNode(INVALID);
+    value_ = createNode(INVALID);
   }
 
-  ParseNode* parseBracedExpression()
+  void parseBracedExpression()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseBracedExpression()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
 
     checkAndAdvance(LBRACE);
-    ParseState state = state_;
+    enter(STEP_BRACE_STATEMENT, pNode);
     state_ = PARSE_STATE_BRACE;
     skipSemicolons();
     if (current().isType(RBRACE))
     {
-      pNode->add(createNode(EMPTY));
+      add(pNode, createNode(EMPTY));
+      closeBracedExpression();
     }
-    else
-    {
-      while (!current().isType(RBRACE))
-      {
-        if (checkUnexpectedEnd(current()))
-          break;
-        pNode->add(parseNonEmptyExpression());
-        skipSemicolons();
-      }
-    }
-    state_ = state;
-    pNode->setEnd(current());
-    checkAndAdvance(RBRACE);
+  }
 
-    return pNode;
+  void parseBracedStatement()
+  {
+    using namespace tokens;
+    if (current().isType(RBRACE) || checkUnexpectedEnd(current()))
+      return closeBracedExpression();
+
+    frames_.back().step = STEP_BRACE_STATEMENT_DONE;
+    parseNonEmptyExpression();
+  }
+
+  void parseBracedStatementDone()
+  {
+    Frame& frame = frames_.back();
+    add(frame.pNode, value_);
+    skipSemicolons();
+    frame.step = STEP_BRACE_STATEMENT;
   }
 
-  ParseNode* parseParentheticalExpression()
+  void closeBracedExpression()
+  {
+    using namespace tokens;
+    ParseNode* pNode = frames_.back().pNode;
+    state_ = frames_.back().state;
+    setEnd(pNode, current());
+    checkAndAdvance(RBRACE);
+    leave(pNode);
+  }
+
+  void parseParentheticalExpression()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseParentheticalExpression()");
     using namespace tokens;
     ParseNode* pNode = createNode(current());
     checkAndAdvance(LPAREN);
-    ParseState state = state_;
+    enter(STEP_PAREN_BODY, pNode);
     state_ = PARSE_STATE_PAREN;
     if (current().isType(RPAREN))
+    {
       unexpectedToken(current());
+      closeParentheticalExpression();
+    }
     else
-      pNode->add(parseNonEmptyExpression());
-    state_ = state;
-    pNode->setEnd(current());
-    checkAndAdvance(RPAREN);
-    return pNode;
+    {
+      parseNonEmptyExpression();
+    }
   }
 
-  ParseNode* parseUnaryOperator()
+  void parseParentheticalBody()
   {
-    SOURCE_TOOLS_DEBUG_PARSER_LOG("parseUnaryOperator()");
-    ParseNode* pNode = createNode(current());
-    pNode->add(parseNonEmptyExpression(precedence::unary(consume())));
-    return pNode;
+    add(frames_.back().pNode, value_);
+    closeParentheticalExpression();
+  }
+
+  void closeParentheticalExpression()
+  {
+    using namespace tokens;
+    ParseNode* pNode = frames_.back().pNode;
+    state_ = frames_.back().state;
+    setEnd(pNode, current());
+    checkAndAdvance(RPAREN);
+    leave(pNode);
   }
 
-  ParseNode* parseExpressionStart()
+  void parseExpressionStart()
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseExpressionStart('" << current().contents() << "')");
     SOURCE_TOOLS_DEBUG_PARSER_LOG("Type: " << toString(current().type()));
@@ -361,40 +570,19 @@ private:
       return parseBracedExpression();
     else if (token.isType(LPAREN))
       return parseParentheticalExpression();
-    else if (isUnaryOperator(token))
-      return parseUnaryOperator();
     else if (isSymbolic(token) || isKeyword(token))
-      return createNode(consume());
+    {
+      value_ = createNode(consume());
+      return;
+    }
     else if (token.isType(END))
-      return NULL;
-
-    unexpectedToken(consume());
-    return createNode(INVALID);
-  }
-
-  ParseNode* parseFunctionCallOne(TokenType rhsType)
-  {
-    using namespace tokens;
-
-    const Token& token = current();
-    if (token.isType(COMMA) || token.isType(rhsType))
-      return createNode(Token(MISSING));
-
-    if (peek(1).isType(OPERATOR_ASSIGN_LEFT_EQUALS))
     {
-      ParseNode* pLhs  = createNode(consume());
-      ParseNode* pNode = createNode(consume());
-      pNode->add(pLhs);
-
-      if (current().isType(COMMA) || current().isType(rhsType))
-        pNode->add(createNode(MISSING));
-      else
-        pNode->add(parseNonEmptyExpression());
-
-      return pNode;
+      value_ = NULL;
+      return;
     }
 
-    return parseNonEmptyExpression();
+    unexpectedToken(consume());
+    value_ = createNode(INVALID);
   }
 
   // Parse a function call, e.g.
@@ -408,84 +596,130 @@ private:
   // Parsing a function call is surprisingly tricky, due to the
   // nature of allowing a mixture of unnamed, named, and missing
   // arguments.
-  ParseNode* parseFunctionCall(ParseNode* pLhs)
+  void parseFunctionCall(ParseNode* pLhs)
+  {
+    enter(STEP_CALL_ARGUMENT, NULL);
+    openFunctionCall(pLhs);
+  }
+
+  // Chained calls, e.g. 'f(a)(b)[c]', share a frame.
+  void openFunctionCall(ParseNode* pLhs)
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseFunctionCall('" << current().contents() << "')");
     using namespace tokens;
+
+    Frame& frame = frames_.back();
     TokenType lhsType = current().type();
-    TokenType rhsType = complement(lhsType);
+    frame.rhsType = complement(lhsType);
 
     ParseNode* pNode = createNode(current());
-    pNode->add(pLhs);
+    add(pNode, pLhs);
+    frame.pNode = pNode;
 
     checkAndAdvance(lhsType);
-
-    ParseState state = state_;
     state_ = PARSE_STATE_PAREN;
 
-    if (current().isType(rhsType))
+    if (current().isType(frame.rhsType))
     {
-      pNode->add(lhsType == LPAREN ?
+      add(pNode, lhsType == LPAREN ?
                    createNode(Token(EMPTY)) :
                    createNode(Token(MISSING)));
+      frame.step = STEP_CALL_CLOSE;
     }
     else
     {
-      while (true)
-      {
-        if (checkUnexpectedEnd(current()))
-          break;
+      frame.step = STEP_CALL_ARGUMENT;
+    }
+  }
 
-        pNode->add(parseFunctionCallOne(rhsType));
+  void parseFunctionCallOne()
+  {
+    using namespace tokens;
 
-        const Token& token = current();
-        if (token.isType(COMMA))
-        {
-          consume();
-          continue;
-        }
-        else if (token.isType(rhsType))
-        {
-          break;
-        }
+    Frame& frame = frames_.back();
+    if (checkUnexpectedEnd(current()))
+    {
+      frame.step = STEP_CALL_CLOSE;
+      return;
+    }
 
-        std::string message = std::string() +
-          "expected ',' or '" + toString(rhsType) + "'";
-        unexpectedToken(current(), message);
-      }
+    frame.step = STEP_CALL_ARGUMENT_DONE;
+
+    const Token& token = current();
+    if (token.isType(COMMA) || token.isType(frame.rhsType))
+    {
+      value_ = createNode(Token(MISSING));
+      return;
     }
 
-    checkAndAdvance(rhsType);
+    if (peek(1).isType(OPERATOR_ASSIGN_LEFT_EQUALS))
+    {
+      ParseNode* pLhs  = createNode(consume());
+      ParseNode* pNode = createNode(consume());
+      add(pNode, pLhs);
 
-    state_ = state;
+      if (current().isType(COMMA) || current().isType(frame.rhsType))
+      {
+        add(pNode, createNode(MISSING));
+        value_ = pNode;
+        return;
+      }
 
-    if (isCallOperator(current()) && canParseExpressionContinuation())
-      return parseFunctionCall(pNode);
-    return pNode;
+      frame.pPending = pNode;
+      frame.step = STEP_CALL_NAMED_ARGUMENT;
+      return parseNonEmptyExpression();
+    }
+
+    parseNonEmptyExpression();
+  }
+
+  void parseFunctionCallNamedArgument()
+  {
+    Frame& frame = frames_.back();
+    add(frame.pPending, value_);
+    value_ = frame.pPending;
+    parseFunctionCallArgumentDone();
   }
 
-  ParseNode* parseExpressionContinuation(ParseNode* pNode)
+  void parseFunctionCallArgumentDone()
   {
     using namespace tokens;
-    SOURCE_TOOLS_DEBUG_PARSER_LOG("parseExpressionContinuation('" << current().contents() << "')");
-    SOURCE_TOOLS_DEBUG_PARSER_LOG("Type: " << toString(current().type()));
 
-    Token token = current();
-    if (isCallOperator(token))
-      return parseFunctionCall(pNode);
-    else if (token.isType(END))
-      return createNode(token);
+    Frame& frame = frames_.back();
+    add(frame.pNode, value_);
 
-    ParseNode* pNew = createNode(token);
-    pNew->add(pNode);
+    const Token& token = current();
+    if (token.isType(COMMA))
+    {
+      consume();
+      frame.step = STEP_CALL_ARGUMENT;
+      return;
+    }
+    else if (token.isType(frame.rhsType))
+    {
+      frame.step = STEP_CALL_CLOSE;
+      return;
+    }
 
-    advance();
-    int precedence =
-      precedence::binary(token) -
-      precedence::isRightAssociative(token);
-    pNew->add(parseNonEmptyExpression(precedence));
+    std::string message = std::string() +
+      "expected ',' or '" + toString(frame.rhsType) + "'";
+    unexpectedToken(current(), message);
+    frame.step = STEP_CALL_ARGUMENT;
+  }
+
+  void closeFunctionCall()
+  {
+    Frame& frame = frames_.back();
+    if (current().isType(frame.rhsType))
+      setEnd(frame.pNode, current());
+    checkAndAdvance(frame.rhsType);
+
+    state_ = frame.state;
 
-    return pNew;
+    if (!isCallOperator(current()) || !canParseExpressionContinuation())
+      return leave(frame.pNode);
+
+    openFunctionCall(frame.pNode);
   }
 
   bool canParseExpressionContinuation(int precedence = 0)
@@ -507,21 +741,129 @@ private:
 
   }
 
-  ParseNode* parseExpression(int precedence = 0)
+  // Parse the operand of a pending operator (or the start of an
+  // expression), pushing any prefix operators onto the operator stack.
+  void parseOperand()
+  {
+    SOURCE_TOOLS_DEBUG_PARSER_LOG("parseOperand('" << current().contents() << "')");
+    Frame& frame = frames_.back();
+
+    skipSemicolons();
+    if (operators_.size() > frame.base && checkUnexpectedEnd(current()))
+    {
+      frame.step = STEP_EXPRESSION_CONTINUATION;
+      value_ = createNode(tokens::MISSING);
+      return;
+    }
+
+    if (isUnaryOperator(current()))
+    {
+      ParseNode* pNode = createNode(current());
+      operators_.push_back(PendingOperator(pNode, precedence::unary(consume())));
+      return;
+    }
+
+    frame.step = STEP_EXPRESSION_CONTINUATION;
+    parseExpressionStart();
+  }
+
+  // Parse an expression by precedence climbing. Rather than recursing
+  // for the operand of each unary and binary operator, operators waiting
+  // on their right-hand side are kept on an explicit stack, so that long
+  // operator chains (e.g. 'a <- b <- c <- ...' or '- - - x') are parsed
+  // in a single frame.
+  void parseExpression(int precedence = 0)
   {
     SOURCE_TOOLS_DEBUG_PARSER_LOG("parseExpression(" << precedence << ")");
+
+    if (depth_ >= options_.maxDepth)
+    {
+      value_ = maximumDepthExceeded();
+      return;
+    }
+
+    ++depth_;
+    enter(STEP_EXPRESSION_OPERAND, NULL);
+    frames_.back().base = operators_.size();
+    frames_.back().precedence = precedence;
+  }
+
+  // The operand (or call) at 'value_' is complete; apply any operators
+  // it completes, and continue the expression.
+  void parseExpressionContinuation()
+  {
     using namespace tokens;
-    ParseNode* pNode = parseExpressionStart();
-    while (canParseExpressionContinuation(precedence))
-      pNode = parseExpressionContinuation(pNode);
-    return pNode;
+
+    Frame& frame = frames_.back();
+    frame.pNode = value_;
+
+    while (true)
+    {
+      int minimum = operators_.size() == frame.base ?
+        frame.precedence :
+        operators_.back().precedence;
+
+      if (!canParseExpressionContinuation(minimum))
+      {
+        if (operators_.size() == frame.base)
+        {
+          --depth_;
+          return leave(frame.pNode);
+        }
+
+        // The operand is complete; it becomes the right-hand side of
+        // the most recent pending operator.
+        ParseNode* pOperator = operators_.back().pNode;
+        operators_.pop_back();
+        add(pOperator, frame.pNode);
+        frame.pNode = pOperator;
+        continue;
+      }
+
+      SOURCE_TOOLS_DEBUG_PARSER_LOG("parseExpressionContinuation('" << current().contents() << "')");
+      Token token = current();
+      if (isCallOperator(token))
+        return parseFunctionCall(frame.pNode);
+      else if (token.isType(END))
+      {
+        frame.pNode = createNode(token);
+        continue;
+      }
+
+      ParseNode* pOperator = createNode(token);
+      add(pOperator, frame.pNode);
+      advance();
+
+      int rhsPrecedence =
+        precedence::binary(token) -
+        precedence::isRightAssociative(token);
+      operators_.push_back(PendingOperator(pOperator, rhsPrecedence));
+      frame.step = STEP_EXPRESSION_OPERAND;
+      return;
+    }
   }
 
-  ParseNode* parseNonEmptyExpression(int precedence = 0)
+  void parseNonEmptyExpression(int precedence = 0)
   {
+    skipSemicolons();
     if (checkUnexpectedEnd(current()))
-      return ParseNode::create(tokens::MISSING);
-    return parseExpression(precedence);
+    {
+      value_ = createNode(tokens::MISSING);
+      return;
+    }
+
+    parseExpression(precedence);
+  }
+
+  // Parse a top-level expression, resuming the constructs it opens until
+  // it is complete.
+  ParseNode* parseTopLevelExpression()
+  {
+    value_ = NULL;
+    parseExpression();
+    while (!frames_.empty())
+      resume();
+    return value_;
   }
 
   // Tokenization ----
@@ -591,16 +933,47 @@ private:
 
   ParseNode* createNode(TokenType type)
   {
+    if (!options_.buildTree)
+      return &placeholder_;
+
     return ParseNode::create(type);
   }
 
   ParseNode* createNode(const Token& token)
   {
+    if (!options_.buildTree)
+      return &placeholder_;
+
     ParseNode* pNode = ParseNode::create(token);
-    pStatus_->recordNodeLocation(token.position(), pNode);
+    if (options_.recordLocations)
+      pStatus_->recordNodeLocation(token.position(), pNode);
     return pNode;
   }
 
+  void add(ParseNode* pParent, ParseNode* pChild)
+  {
+    // 'pChild' is NULL when the input ends where an expression was
+    // expected.
+    if (!options_.buildTree || pChild == NULL)
+      return;
+
+    if (options_.deferRanges)
+      pParent->append(pChild);
+    else
+      pParent->add(pChild);
+  }
+
+  void setEnd(ParseNode* pNode, const Token& end)
+  {
+    if (!options_.buildTree)
+      return;
+
+    if (options_.deferRanges)
+      pNode->setLocalEnd(end);
+    else
+      pNode->setEnd(end);
+  }
+
   void skipSemicolons()
   {
     while (current().isType(tokens::SEMI))
@@ -621,13 +994,19 @@ public:
 
     while (true)
     {
-      ParseNode* pNode = parseExpression();
+      ParseNode* pNode = parseTopLevelExpression();
       if (!pNode)
         break;
 
-      root->add(pNode);
+      add(root, pNode);
     }
 
+    if (!options_.buildTree)
+      return NULL;
+
+    if (options_.deferRanges)
+      root->updateRanges();
+
     return root;
   }
 
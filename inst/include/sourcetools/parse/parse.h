@@ -2,9 +2,12 @@
 #define SOURCETOOLS_PARSE_PARSE_H
 
 #include <sourcetools/parse/ParseNode.h>
+#include <sourcetools/parse/Names.h>
 #include <sourcetools/parse/Precedence.h>
+#include <sourcetools/parse/ParseOptions.h>
 #include <sourcetools/parse/ParseError.h>
 #include <sourcetools/parse/ParseStatus.h>
 #include <sourcetools/parse/Parser.h>
+#include <sourcetools/parse/ParseData.h>
 
 #endif /* SOURCETOOLS_PARSE_PARSE_H */
@@ -0,0 +1,326 @@
+#ifndef SOURCETOOLS_R_R_ALTREP_H
+#define SOURCETOOLS_R_R_ALTREP_H
+
+#include <algorithm>
+
+#include <sourcetools/core/core.h>
+
+#include <sourcetools/r/RHeaders.h>
+#include <sourcetools/r/RProtect.h>
+#include <sourcetools/r/RExternalPointer.h>
+
+#include <Rversion.h>
+#include <R_ext/Rdynload.h>
+
+// ALTREP is available from R 3.5.0, but the headers shipped with
+// R 3.5.x cannot be included from C++ (they use 'class' as an
+// identifier). We only enable ALTREP support for R >= 3.6.0, and
+// fall back to eagerly materialized vectors otherwise.
+#if defined(R_VERSION) && R_VERSION >= R_Version(3, 6, 0)
+# define SOURCETOOLS_R_ALTREP
+#endif
+
+#ifdef SOURCETOOLS_R_ALTREP
+# include <R_ext/Altrep.h>
+#endif
+
+namespace sourcetools {
+namespace r {
+namespace altrep {
+
+// Lazy vectors backed by a C++ object. The object is owned by an
+// external pointer held in the first ALTREP data slot (and so can be
+// shared between several vectors); the second slot holds a fully
+// materialized copy, created only when R requests a pointer to the
+// vector's data.
+//
+// 'Traits' describes how elements are produced:
+//
+//    typedef ... Object;
+//    static const char* name();
+//    static R_xlen_t size(const Object& object);
+//    static SEXP elt(const Object& object, R_xlen_t i);  // for strings
+//    static int  elt(const Object& object, R_xlen_t i);  // for integers
+//
+// Element access and subsetting go through 'Traits::elt()' directly,
+// so only the requested elements are ever created.
+template <typename Traits>
+typename Traits::Object& object(SEXP pointerSEXP)
+{
+  typedef typename Traits::Object Object;
+  Object* pObject = externalPointerAddress<Object>(pointerSEXP);
+  if (pObject == NULL)
+    Rf_error("internal error: '%s' data has been released", Traits::name());
+  return *pObject;
+}
+
+namespace detail {
+
+inline void set(SEXP dataSEXP, R_xlen_t i, SEXP value)
+{
+  SET_STRING_ELT(dataSEXP, i, value);
+}
+
+inline void set(SEXP dataSEXP, R_xlen_t i, int value)
+{
+  INTEGER(dataSEXP)[i] = value;
+}
+
+inline void setNA(SEXP dataSEXP, R_xlen_t i)
+{
+  if (TYPEOF(dataSEXP) == STRSXP)
+    SET_STRING_ELT(dataSEXP, i, NA_STRING);
+  else
+    INTEGER(dataSEXP)[i] = NA_INTEGER;
+}
+
+} // namespace detail
+
+template <typename Traits, SEXPTYPE RTYPE>
+SEXP materialize(const typename Traits::Object& object)
+{
+  R_xlen_t n = Traits::size(object);
+  Protect protect;
+  SEXP resultSEXP = protect(Rf_allocVector(RTYPE, n));
+  for (R_xlen_t i = 0; i < n; ++i)
+    detail::set(resultSEXP, i, Traits::elt(object, i));
+  return resultSEXP;
+}
+
+#ifdef SOURCETOOLS_R_ALTREP
+
+template <typename Traits, SEXPTYPE RTYPE>
+class VectorBase
+{
+public:
+
+  typedef typename Traits::Object Object;
+
+  static Object& data(SEXP x)
+  {
+    return object<Traits>(R_altrep_data1(x));
+  }
+
+  static SEXP materialized(SEXP x)
+  {
+    return R_altrep_data2(x);
+  }
+
+  static R_xlen_t Length(SEXP x)
+  {
+    SEXP dataSEXP = materialized(x);
+    if (dataSEXP != R_NilValue)
+      return Rf_xlength(dataSEXP);
+    return Traits::size(data(x));
+  }
+
+  static Rboolean Inspect(SEXP x, int pre, int deep, int pvec,
+                          void (*inspect_subtree)(SEXP, int, int, int))
+  {
+    Rprintf("%s (len=%ld, materialized=%s)\n",
+            Traits::name(),
+            static_cast<long>(Length(x)),
+            materialized(x) != R_NilValue ? "T" : "F");
+    return TRUE;
+  }
+
+  static const void* Dataptr_or_null(SEXP x)
+  {
+    SEXP dataSEXP = materialized(x);
+    if (dataSEXP == R_NilValue)
+      return NULL;
+    return dataptr(dataSEXP);
+  }
+
+  static void* Dataptr(SEXP x, Rboolean writeable)
+  {
+    return dataptr(materialize(x));
+  }
+
+  static SEXP materialize(SEXP x)
+  {
+    SEXP dataSEXP = materialized(x);
+    if (dataSEXP != R_NilValue)
+      return dataSEXP;
+
+    Protect protect;
+    dataSEXP = protect(altrep::materialize<Traits, RTYPE>(data(x)));
+    R_set_altrep_data2(x, dataSEXP);
+    return dataSEXP;
+  }
+
+  static SEXP Extract_subset(SEXP x, SEXP indexSEXP, SEXP callSEXP)
+  {
+    if (materialized(x) != R_NilValue)
+      return NULL;
+
+    if (TYPEOF(indexSEXP) != INTSXP && TYPEOF(indexSEXP) != REALSXP)
+      return NULL;
+
+    const Object& object = data(x);
+    R_xlen_t size = Traits::size(object);
+    R_xlen_t n = Rf_xlength(indexSEXP);
+
+    Protect protect;
+    SEXP resultSEXP = protect(Rf_allocVector(RTYPE, n));
+    for (R_xlen_t i = 0; i < n; ++i)
+    {
+      R_xlen_t index = subscript(indexSEXP, i);
+      if (index < 0 || index >= size)
+        detail::setNA(resultSEXP, i);
+      else
+        detail::set(resultSEXP, i, Traits::elt(object, index));
+    }
+
+    return resultSEXP;
+  }
+
+  static SEXP create(R_altrep_class_t klass, SEXP pointerSEXP)
+  {
+    return R_new_altrep(klass, pointerSEXP, R_NilValue);
+  }
+
+  static void registerMethods(R_altrep_class_t klass)
+  {
+    R_set_altrep_Length_method(klass, Length);
+    R_set_altrep_Inspect_method(klass, Inspect);
+    R_set_altvec_Dataptr_method(klass, Dataptr);
+    R_set_altvec_Dataptr_or_null_method(klass, Dataptr_or_null);
+    R_set_altvec_Extract_subset_method(klass, Extract_subset);
+  }
+
+private:
+
+  // Convert an R (1-based) subscript to a 0-based index, with -1
+  // used for NA subscripts.
+  static R_xlen_t subscript(SEXP indexSEXP, R_xlen_t i)
+  {
+    if (TYPEOF(indexSEXP) == INTSXP)
+    {
+      int value = INTEGER(indexSEXP)[i];
+      return value == NA_INTEGER ? -1 : value - 1;
+    }
+
+    double value = REAL(indexSEXP)[i];
+    return ISNAN(value) ? -1 : static_cast<R_xlen_t>(value) - 1;
+  }
+
+  static void* dataptr(SEXP dataSEXP)
+  {
+    if (RTYPE == STRSXP)
+      return const_cast<SEXP*>(STRING_PTR_RO(dataSEXP));
+    return INTEGER(dataSEXP);
+  }
+};
+
+template <typename Traits>
+class String : public VectorBase<Traits, STRSXP>
+{
+  typedef VectorBase<Traits, STRSXP> Base;
+
+public:
+
+  static SEXP Elt(SEXP x, R_xlen_t i)
+  {
+    SEXP dataSEXP = Base::materialized(x);
+    if (dataSEXP != R_NilValue)
+      return STRING_ELT(dataSEXP, i);
+    return Traits::elt(Base::data(x), i);
+  }
+
+  static void Set_elt(SEXP x, R_xlen_t i, SEXP value)
+  {
+    SET_STRING_ELT(Base::materialize(x), i, value);
+  }
+
+  static int No_NA(SEXP x)
+  {
+    return Base::materialized(x) == R_NilValue;
+  }
+
+  static SEXP create(SEXP pointerSEXP)
+  {
+    return Base::create(class_, pointerSEXP);
+  }
+
+  static void init(DllInfo* dll)
+  {
+    class_ = R_make_altstring_class(Traits::name(), "sourcetools", dll);
+    Base::registerMethods(class_);
+    R_set_altstring_Elt_method(class_, Elt);
+    R_set_altstring_Set_elt_method(class_, Set_elt);
+    R_set_altstring_No_NA_method(class_, No_NA);
+  }
+
+private:
+  static R_altrep_class_t class_;
+};
+
+template <typename Traits>
+R_altrep_class_t String<Traits>::class_;
+
+template <typename Traits>
+class Integer : public VectorBase<Traits, INTSXP>
+{
+  typedef VectorBase<Traits, INTSXP> Base;
+
+public:
+
+  static int Elt(SEXP x, R_xlen_t i)
+  {
+    SEXP dataSEXP = Base::materialized(x);
+    if (dataSEXP != R_NilValue)
+      return INTEGER(dataSEXP)[i];
+    return Traits::elt(Base::data(x), i);
+  }
+
+  static R_xlen_t Get_region(SEXP x, R_xlen_t i, R_xlen_t n, int* buffer)
+  {
+    R_xlen_t count = std::min(n, Base::Length(x) - i);
+
+    SEXP dataSEXP = Base::materialized(x);
+    if (dataSEXP != R_NilValue)
+    {
+      std::copy(INTEGER(dataSEXP) + i, INTEGER(dataSEXP) + i + count, buffer);
+      return count;
+    }
+
+    const typename Traits::Object& object = Base::data(x);
+    for (R_xlen_t k = 0; k < count; ++k)
+      buffer[k] = Traits::elt(object, i + k);
+    return count;
+  }
+
+  static int No_NA(SEXP x)
+  {
+    return Base::materialized(x) == R_NilValue;
+  }
+
+  static SEXP create(SEXP pointerSEXP)
+  {
+    return Base::create(class_, pointerSEXP);
+  }
+
+  static void init(DllInfo* dll)
+  {
+    class_ = R_make_altinteger_class(Traits::name(), "sourcetools", dll);
+    Base::registerMethods(class_);
+    R_set_altinteger_Elt_method(class_, Elt);
+    R_set_altinteger_Get_region_method(class_, Get_region);
+    R_set_altinteger_No_NA_method(class_, No_NA);
+  }
+
+private:
+  static R_altrep_class_t class_;
+};
+
+template <typename Traits>
+R_altrep_class_t Integer<Traits>::class_;
+
+#endif /* SOURCETOOLS_R_ALTREP */
+
+} // namespace altrep
+} // namespace r
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_R_R_ALTREP_H */
@@ -12,6 +12,10 @@
 namespace sourcetools {
 namespace r {
 
+// Walks the calls within an R expression (or a function's body),
+// applying each operation to every node in pre-order. The walk keeps
+// its own stack rather than recursing, so deeply nested code cannot
+// overflow the C stack, and ends as soon as any operation is done.
 class CallRecurser : noncopyable
 {
 public:
@@ -20,6 +24,11 @@ public:
   {
   public:
     virtual void apply(SEXP dataSEXP) = 0;
+
+    // Whether the operation has seen all it needs to; once any
+    // operation is done, no more nodes are visited.
+    virtual bool done() const { return false; }
+
     virtual ~Operation() {}
   };
 
@@ -28,7 +37,7 @@ public:
     if (Rf_isPrimitive(dataSEXP))
       dataSEXP_ = R_NilValue;
     else if (Rf_isFunction(dataSEXP))
-      dataSEXP_ = r::util::functionBody(dataSEXP);
+      dataSEXP_ = body(dataSEXP);
     else if (TYPEOF(dataSEXP) == LANGSXP)
       dataSEXP_ = dataSEXP;
     else
@@ -42,29 +51,56 @@ public:
 
   void run()
   {
-    runImpl(dataSEXP_);
+    // The stack holds the remainder of each call being walked.
+    std::vector<SEXP> stack;
+    if (!visit(dataSEXP_, &stack))
+      return;
+
+    while (!stack.empty())
+    {
+      SEXP callSEXP = stack.back();
+      if (callSEXP == R_NilValue)
+      {
+        stack.pop_back();
+        continue;
+      }
+
+      stack.back() = CDR(callSEXP);
+      if (!visit(CAR(callSEXP), &stack))
+        return;
+    }
   }
 
-  void runImpl(SEXP dataSEXP)
+private:
+
+  // Apply the operations to a node, and queue its elements if it is a
+  // call. Returns false once the walk should end.
+  bool visit(SEXP dataSEXP, std::vector<SEXP>* pStack)
   {
     for (std::vector<Operation*>::iterator it = operations_.begin();
          it != operations_.end();
          ++it)
     {
       (*it)->apply(dataSEXP);
+      if ((*it)->done())
+        return false;
     }
 
     if (TYPEOF(dataSEXP) == LANGSXP)
-    {
-      while (dataSEXP != R_NilValue)
-      {
-        runImpl(CAR(dataSEXP));
-        dataSEXP = CDR(dataSEXP);
-      }
-    }
+      pStack->push_back(dataSEXP);
+
+    return true;
+  }
+
+  // The body of a closure, as written. Compiled closures keep it among
+  // their constants, where 'body()' knows to find it.
+  static SEXP body(SEXP fnSEXP)
+  {
+    if (TYPEOF(fnSEXP) == CLOSXP && TYPEOF(closureBody(fnSEXP)) != BCODESXP)
+      return closureBody(fnSEXP);
+    return r::util::functionBody(fnSEXP);
   }
 
-private:
   SEXP dataSEXP_;
   std::vector<Operation*> operations_;
 };
@@ -0,0 +1,54 @@
+#ifndef SOURCETOOLS_R_R_EXTERNAL_POINTER_H
+#define SOURCETOOLS_R_R_EXTERNAL_POINTER_H
+
+#include <sourcetools/r/RHeaders.h>
+#include <sourcetools/r/RProtect.h>
+
+namespace sourcetools {
+namespace r {
+
+namespace detail {
+
+template <typename T>
+void finalizeExternalPointer(SEXP pointerSEXP)
+{
+  T* pObject = static_cast<T*>(R_ExternalPtrAddr(pointerSEXP));
+  if (pObject == NULL)
+    return;
+
+  delete pObject;
+  R_ClearExternalPtr(pointerSEXP);
+}
+
+} // namespace detail
+
+// Wrap a heap-allocated object in an external pointer, transferring
+// ownership to R. The object is deleted when the pointer is collected.
+// 'protectedSEXP' is kept alive for as long as the pointer is; use it
+// for R objects that the C++ object refers to (e.g. a CHARSXP whose
+// buffer it tokenized). The object may be NULL, and given later with
+// 'R_SetExternalPtrAddr()', so that it is only created once the pointer
+// that will own it exists.
+template <typename T>
+SEXP createExternalPointer(T* pObject,
+                           SEXP tagSEXP = R_NilValue,
+                           SEXP protectedSEXP = R_NilValue)
+{
+  Protect protect;
+  SEXP pointerSEXP = protect(R_MakeExternalPtr(pObject, tagSEXP, protectedSEXP));
+  R_RegisterCFinalizerEx(pointerSEXP, detail::finalizeExternalPointer<T>, TRUE);
+  return pointerSEXP;
+}
+
+template <typename T>
+T* externalPointerAddress(SEXP pointerSEXP)
+{
+  if (TYPEOF(pointerSEXP) != EXTPTRSXP)
+    return NULL;
+  return static_cast<T*>(R_ExternalPtrAddr(pointerSEXP));
+}
+
+} // namespace r
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_R_R_EXTERNAL_POINTER_H */
@@ -2,7 +2,6 @@
 #define SOURCETOOLS_R_R_FUNCTIONS_H
 
 #include <string>
-#include <set>
 
 #include <sourcetools/r/RUtils.h>
 
@@ -23,28 +22,6 @@ inline SEXP eval(const std::string& fn, SEXP envSEXP = NULL)
   return resultSEXP;
 }
 
-inline std::set<std::string> objectsOnSearchPath()
-{
-  std::set<std::string> results;
-  Protect protect;
-
-  SEXP objectsSEXP;
-  protect(objectsSEXP = eval("search_objects"));
-
-  for (R_xlen_t i = 0; i < Rf_length(objectsSEXP); ++i)
-  {
-    SEXP strSEXP = VECTOR_ELT(objectsSEXP, i);
-    for (R_xlen_t j = 0; j < Rf_length(strSEXP); ++j)
-    {
-      SEXP charSEXP = STRING_ELT(strSEXP, j);
-      std::string element(CHAR(charSEXP), Rf_length(charSEXP));
-      results.insert(element);
-    }
-  }
-
-  return results;
-}
-
 namespace util {
 
 inline void setNames(SEXP dataSEXP, const char** names, index_type n)
@@ -1,11 +1,15 @@
 #ifndef SOURCETOOLS_R_R_NON_STANDARD_EVALUATION_H
 #define SOURCETOOLS_R_R_NON_STANDARD_EVALUATION_H
 
-#include <set>
+#include <algorithm>
 #include <map>
+#include <vector>
 
 #include <sourcetools/r/RHeaders.h>
+#include <sourcetools/r/RProtect.h>
+#include <sourcetools/r/RUtils.h>
 #include <sourcetools/r/RCallRecurser.h>
+#include <sourcetools/parse/Names.h>
 
 namespace sourcetools {
 namespace r {
@@ -13,32 +17,64 @@ namespace nse {
 
 namespace detail {
 
-inline std::set<std::string> makeNsePrimitives()
-{
-  std::set<std::string> instance;
+// Functions whose use marks the caller as performing non-standard
+// evaluation.
+static const char* const kNsePrimitives[] = {
+  "eval",
+  "evalq",
+  "lazy_dots",
+  "quote",
+  "substitute"
+};
 
-  instance.insert("quote");
-  instance.insert("substitute");
-  instance.insert("eval");
-  instance.insert("evalq");
-  instance.insert("lazy_dots");
+static const index_type kNsePrimitivesCount =
+  sizeof(kNsePrimitives) / sizeof(kNsePrimitives[0]);
 
-  return instance;
+inline bool isNsePrimitive(const char* name)
+{
+  return names::contains(kNsePrimitives, name);
 }
 
-inline std::set<std::string>& nsePrimitives()
+// The symbols the analysis looks for, installed once up front rather
+// than on every call visited.
+class Symbols
 {
-  static std::set<std::string> instance = makeNsePrimitives();
-  return instance;
-}
+public:
+
+  Symbols()
+    : doubleColon(Rf_install("::")),
+      tripleColon(Rf_install(":::")),
+      lazyeval(Rf_install("lazyeval")),
+      lazyDots(Rf_install("lazy_dots")),
+      lazyLoadDBfetch(Rf_install("lazyLoadDBfetch"))
+  {
+    for (index_type i = 0; i < kNsePrimitivesCount; ++i)
+      primitives_.push_back(Rf_install(kNsePrimitives[i]));
+  }
+
+  bool isNsePrimitive(SEXP symSEXP) const
+  {
+    return std::find(primitives_.begin(), primitives_.end(), symSEXP) !=
+           primitives_.end();
+  }
+
+  SEXP doubleColon;
+  SEXP tripleColon;
+  SEXP lazyeval;
+  SEXP lazyDots;
+  SEXP lazyLoadDBfetch;
+
+private:
+  std::vector<SEXP> primitives_;
+};
 
 class PerformsNonStandardEvaluationOperation
   : public r::CallRecurser::Operation
 {
 public:
 
-  PerformsNonStandardEvaluationOperation()
-    : status_(false)
+  explicit PerformsNonStandardEvaluationOperation(const Symbols& symbols)
+    : symbols_(symbols), status_(false)
   {
   }
 
@@ -52,29 +88,27 @@ public:
 
     SEXP fnSEXP = CAR(dataSEXP);
     if (TYPEOF(fnSEXP) == SYMSXP)
-      status_ = nsePrimitives().count(CHAR(PRINTNAME(fnSEXP)));
+      status_ = symbols_.isNsePrimitive(fnSEXP);
     else if (TYPEOF(fnSEXP) == STRSXP)
-      status_ = nsePrimitives().count(CHAR(STRING_ELT(fnSEXP, 0)));
+      status_ = isNsePrimitive(CHAR(STRING_ELT(fnSEXP, 0)));
 
   }
 
+  virtual bool done() const { return status_; }
+
   bool status() const { return status_; }
 
 private:
 
   bool checkCall(SEXP callSEXP)
   {
-    index_type n = Rf_length(callSEXP);
-    if (n == 0)
-      return false;
-
     SEXP fnSEXP = CAR(callSEXP);
-    if (fnSEXP == Rf_install("::") || fnSEXP == Rf_install(":::"))
+    if (fnSEXP == symbols_.doubleColon || fnSEXP == symbols_.tripleColon)
     {
       SEXP lhsSEXP = CADR(callSEXP);
       SEXP rhsSEXP = CADDR(callSEXP);
 
-      if (lhsSEXP == Rf_install("lazyeval") && rhsSEXP == Rf_install("lazy_dots"))
+      if (lhsSEXP == symbols_.lazyeval && rhsSEXP == symbols_.lazyDots)
         return true;
     }
 
@@ -82,64 +116,526 @@ private:
   }
 
 private:
+  const Symbols& symbols_;
   bool status_;
 };
 
+// Records the functions a body forwards its '...' arguments to, by
+// the names they are called with.
+class ForwardsDotsOperation : public r::CallRecurser::Operation
+{
+public:
+
+  virtual void apply(SEXP dataSEXP)
+  {
+    if (TYPEOF(dataSEXP) != LANGSXP || TYPEOF(CAR(dataSEXP)) != SYMSXP)
+      return;
+
+    for (SEXP argsSEXP = CDR(dataSEXP); argsSEXP != R_NilValue; argsSEXP = CDR(argsSEXP))
+    {
+      if (CAR(argsSEXP) == R_DotsSymbol)
+      {
+        callees_.push_back(CAR(dataSEXP));
+        return;
+      }
+    }
+  }
+
+  const std::vector<SEXP>& callees() const { return callees_; }
+
+private:
+  std::vector<SEXP> callees_;
+};
+
+// Whether a promise was made by lazy loading (e.g. for an object in a
+// package namespace), and so only reads the object from its database.
+inline bool isLazyLoadPromise(SEXP promiseSEXP, const Symbols& symbols)
+{
+  SEXP codeSEXP = PRCODE(promiseSEXP);
+  return TYPEOF(codeSEXP) == LANGSXP && CAR(codeSEXP) == symbols.lazyLoadDBfetch;
+}
+
+// Find the function a call to 'symSEXP' made from 'envSEXP' would
+// invoke, as R does, skipping bindings that are not functions. Returns
+// R_NilValue if there is none, or if it cannot be known without running
+// code.
+inline SEXP findFunction(SEXP symSEXP, SEXP envSEXP, const Symbols& symbols)
+{
+  for (; envSEXP != R_EmptyEnv; envSEXP = parentEnv(envSEXP))
+  {
+    SEXP valueSEXP = Rf_findVarInFrame(envSEXP, symSEXP);
+    if (valueSEXP == R_UnboundValue)
+      continue;
+
+    // Arguments and objects in lazy-loaded namespaces are bound to
+    // promises. Forcing an argument could run any code, so only promises
+    // forced already, and those reading an object from a lazy-load
+    // database, are looked through. The latter are forced in a
+    // top-level context, so that an R error cannot unwind through our
+    // frames; any other call is taken to invoke no function we can
+    // analyze.
+    if (TYPEOF(valueSEXP) == PROMSXP)
+    {
+      if (PRVALUE(valueSEXP) != R_UnboundValue)
+      {
+        valueSEXP = PRVALUE(valueSEXP);
+      }
+      else
+      {
+        if (!isLazyLoadPromise(valueSEXP, symbols))
+          return R_NilValue;
+
+        r::Protect protect;
+        int error = 0;
+        valueSEXP = R_tryEvalSilent(protect(valueSEXP), envSEXP, &error);
+        if (error)
+          return R_NilValue;
+      }
+    }
+
+    if (Rf_isFunction(valueSEXP))
+      return valueSEXP;
+  }
+
+  return R_NilValue;
+}
+
 } // namespace detail
 
-class Database
+// What walking a function's body found: whether it performs
+// non-standard evaluation itself and, if not, the names of the
+// functions it forwards '...' to.
+struct Summary
+{
+  Summary()
+    : direct(false)
+  {
+  }
+
+  bool direct;
+  std::vector<SEXP> callees;
+};
+
+// Memoizes the results of the analysis, for a bounded number of
+// functions, evicting the least recently used when full. There is no
+// shared instance: whoever owns a database decides its lifetime, and as
+// the analysis calls into R, it may only be used on the main thread.
+//
+// Entries are keyed by the identity of a closure, and hold the summary
+// of its body rather than the final result: the functions it forwards
+// '...' to are looked up by name on every use, so redefining one of
+// them is seen, and closures sharing a body are told apart by their
+// environments. The database holds a reference to each closure it has
+// an entry for, so a closure cannot be collected, and its address reused
+// by another object, while its entry remains.
+class Database : noncopyable
 {
 public:
-  bool check(SEXP dataSEXP)
+
+  struct Statistics
   {
-    if (contains(dataSEXP))
-      return get(dataSEXP);
+    Statistics()
+      : hits(0), misses(0), evictions(0)
+    {
+    }
 
-    typedef detail::PerformsNonStandardEvaluationOperation Operation;
-    scoped_ptr<Operation> operation(new Operation);
+    double hits;
+    double misses;
+    double evictions;
+  };
 
-    r::CallRecurser recurser(dataSEXP);
-    recurser.add(operation);
-    recurser.run();
+  explicit Database(index_type capacity = 8192)
+    : keysSEXP_(R_NilValue)
+  {
+    reset(capacity);
+  }
+
+  ~Database()
+  {
+    if (keysSEXP_ != R_NilValue)
+      R_ReleaseObject(keysSEXP_);
+  }
+
+  // Whether 'dataSEXP' performs non-standard evaluation, walking it
+  // (and the functions it forwards '...' to) if there is no entry for
+  // it.
+  bool check(SEXP dataSEXP);
+
+  // Look up the entry for 'dataSEXP', making it the most recently used.
+  bool find(SEXP dataSEXP, Summary* pSummary)
+  {
+    SEXP keySEXP = key(dataSEXP);
+    if (keySEXP == R_NilValue || capacity_ == 0)
+      return false;
+
+    index_type slot = find(keySEXP);
+    if (slot == -1)
+    {
+      ++statistics_.misses;
+      return false;
+    }
+
+    ++statistics_.hits;
+    unlink(slot);
+    link(slot);
+    *pSummary = slots_[slot].summary;
+    return true;
+  }
+
+  void insert(SEXP dataSEXP, const Summary& summary)
+  {
+    SEXP keySEXP = key(dataSEXP);
+    if (keySEXP == R_NilValue || capacity_ == 0)
+      return;
+
+    index_type slot = find(keySEXP);
+    if (slot != -1)
+      slots_[slot].summary = summary;
+    else
+      insertKey(keySEXP, summary);
+  }
+
+  // The most entries a database keeps, whatever capacity is asked for;
+  // this also keeps the number of buckets well within range.
+  static index_type maxCapacity() { return 1 << 20; }
+
+  // Drop every entry, and change the number of entries kept.
+  void reset(index_type capacity)
+  {
+    if (keysSEXP_ != R_NilValue)
+    {
+      R_ReleaseObject(keysSEXP_);
+      keysSEXP_ = R_NilValue;
+    }
+
+    capacity_ = std::min(std::max(capacity, 0), maxCapacity());
+    slots_.clear();
+    slots_.reserve(capacity_);
+
+    index_type buckets = 1;
+    while (buckets < 2 * capacity_)
+      buckets *= 2;
+    buckets_.assign(buckets, -1);
+
+    head_ = tail_ = -1;
+    statistics_ = Statistics();
+  }
+
+  index_type size() const { return utils::size(slots_); }
+  index_type capacity() const { return capacity_; }
+  const Statistics& statistics() const { return statistics_; }
 
-    set(dataSEXP, operation->status());
-    return operation->status();
+private:
+
+  struct Slot
+  {
+    SEXP keySEXP;
+    Summary summary;
+
+    // Neighbours in order of use, most recent first.
+    index_type previous;
+    index_type next;
+
+    // The next slot in the same bucket.
+    index_type chain;
+  };
+
+  static SEXP key(SEXP dataSEXP)
+  {
+    if (TYPEOF(dataSEXP) == CLOSXP || TYPEOF(dataSEXP) == LANGSXP)
+      return dataSEXP;
+    return R_NilValue;
+  }
+
+  index_type bucket(SEXP keySEXP) const
+  {
+    std::size_t hash = reinterpret_cast<std::size_t>(keySEXP) >> 4;
+    hash ^= hash >> 15;
+    hash *= 2654435761u;
+    hash ^= hash >> 13;
+    return static_cast<index_type>(hash & (buckets_.size() - 1));
+  }
+
+  index_type find(SEXP keySEXP) const
+  {
+    for (index_type slot = buckets_[bucket(keySEXP)];
+         slot != -1;
+         slot = slots_[slot].chain)
+    {
+      if (slots_[slot].keySEXP == keySEXP)
+        return slot;
+    }
+    return -1;
+  }
+
+  void insertKey(SEXP keySEXP, const Summary& summary)
+  {
+    if (keysSEXP_ == R_NilValue)
+    {
+      keysSEXP_ = Rf_allocVector(VECSXP, capacity_);
+      R_PreserveObject(keysSEXP_);
+    }
+
+    index_type slot;
+    if (size() < capacity_)
+    {
+      slot = size();
+      slots_.push_back(Slot());
+    }
+    else
+    {
+      slot = tail_;
+      unlink(slot);
+      unchain(slot);
+      ++statistics_.evictions;
+    }
+
+    Slot& entry = slots_[slot];
+    entry.keySEXP = keySEXP;
+    entry.summary = summary;
+    SET_VECTOR_ELT(keysSEXP_, slot, keySEXP);
+
+    index_type index = bucket(keySEXP);
+    entry.chain = buckets_[index];
+    buckets_[index] = slot;
+
+    link(slot);
+  }
+
+  // Make a slot the most recently used.
+  void link(index_type slot)
+  {
+    slots_[slot].previous = -1;
+    slots_[slot].next = head_;
+    if (head_ != -1)
+      slots_[head_].previous = slot;
+    head_ = slot;
+    if (tail_ == -1)
+      tail_ = slot;
+  }
+
+  void unlink(index_type slot)
+  {
+    const Slot& entry = slots_[slot];
+    if (entry.previous != -1)
+      slots_[entry.previous].next = entry.next;
+    else
+      head_ = entry.next;
+
+    if (entry.next != -1)
+      slots_[entry.next].previous = entry.previous;
+    else
+      tail_ = entry.previous;
+  }
+
+  void unchain(index_type slot)
+  {
+    index_type* pSlot = &buckets_[bucket(slots_[slot].keySEXP)];
+    while (*pSlot != slot)
+      pSlot = &slots_[*pSlot].chain;
+    *pSlot = slots_[slot].chain;
+  }
+
+  SEXP keysSEXP_;
+  index_type capacity_;
+
+  std::vector<Slot> slots_;
+  std::vector<index_type> buckets_;
+  index_type head_;
+  index_type tail_;
+
+  Statistics statistics_;
+};
+
+// The interprocedural analysis. A function performs non-standard
+// evaluation if its body calls one of the functions doing so directly
+// (e.g. 'substitute()'), or if it forwards its '...' arguments to a
+// function that performs non-standard evaluation.
+//
+// Each body is walked once, to find both what it does itself and the
+// functions it forwards '...' to, which are found as a call from the
+// function's environment would find them. This gives a call graph over
+// the functions analyzed and those they reach, along which the property
+// is propagated back to callers until nothing changes, so recursion is
+// handled. Functions with an entry in the database are not walked again,
+// and the summaries of those that were are added to it; the graph itself
+// is built afresh every time.
+class Analysis : noncopyable
+{
+public:
+
+  explicit Analysis(Database* pDatabase = NULL)
+    : pDatabase_(pDatabase)
+  {
+  }
+
+  void run(const std::vector<SEXP>& fns, std::vector<bool>* pResults)
+  {
+    std::vector<index_type> roots;
+    for (index_type i = 0; i < utils::size(fns); ++i)
+      roots.push_back(add(fns[i]));
+
+    // Visit the functions, adding those they forward to as we go.
+    for (index_type i = 0; i < utils::size(nodes_); ++i)
+      visit(i);
+
+    propagate();
+
+    pResults->clear();
+    for (index_type i = 0; i < utils::size(roots); ++i)
+      pResults->push_back(nodes_[roots[i]].status);
+  }
+
+  bool run(SEXP fnSEXP)
+  {
+    std::vector<bool> results;
+    run(std::vector<SEXP>(1, fnSEXP), &results);
+    return results[0];
   }
 
 private:
 
-  bool contains(SEXP dataSEXP)
+  struct Node
+  {
+    explicit Node(SEXP fnSEXP)
+      : fnSEXP(fnSEXP), status(false), known(false)
+    {
+    }
+
+    SEXP fnSEXP;
+    bool status;
+
+    // The summary of the function's body, and whether it was found in
+    // the database.
+    Summary summary;
+    bool known;
+
+    // The functions forwarding '...' to this one.
+    std::vector<index_type> callers;
+  };
+
+  // Functions are identified as in the database: two closures sharing
+  // a body are distinct nodes, as they may forward '...' to different
+  // functions.
+  index_type add(SEXP fnSEXP)
   {
-    return map_.count(address(dataSEXP));
+    std::map<SEXP, index_type>::const_iterator it = indices_.find(fnSEXP);
+    if (it != indices_.end())
+      return it->second;
+
+    index_type index = utils::size(nodes_);
+    nodes_.push_back(Node(fnSEXP));
+    indices_[fnSEXP] = index;
+
+    Node& node = nodes_.back();
+    if (pDatabase_ != NULL)
+      node.known = pDatabase_->find(fnSEXP, &node.summary);
+
+    return index;
   }
 
-  bool get(SEXP dataSEXP)
+  void visit(index_type index)
   {
-    return map_[address(dataSEXP)];
+    SEXP fnSEXP = nodes_[index].fnSEXP;
+    if (!nodes_[index].known)
+    {
+      walk(fnSEXP, &nodes_[index].summary);
+      if (pDatabase_ != NULL)
+        pDatabase_->insert(fnSEXP, nodes_[index].summary);
+    }
+
+    // Copied, as adding a node may move the others.
+    Summary summary = nodes_[index].summary;
+    nodes_[index].status = summary.direct;
+    if (summary.direct || TYPEOF(fnSEXP) != CLOSXP)
+      return;
+
+    for (index_type i = 0; i < utils::size(summary.callees); ++i)
+    {
+      SEXP calleeSEXP = detail::findFunction(summary.callees[i], closureEnv(fnSEXP), symbols_);
+      if (TYPEOF(calleeSEXP) != CLOSXP)
+        continue;
+
+      index_type callee = add(calleeSEXP);
+      nodes_[callee].callers.push_back(index);
+    }
   }
 
-  void set(SEXP dataSEXP, bool value)
+  void walk(SEXP fnSEXP, Summary* pSummary)
   {
-    map_[address(dataSEXP)] = value;
+    typedef detail::PerformsNonStandardEvaluationOperation Direct;
+    typedef detail::ForwardsDotsOperation Forwards;
+    scoped_ptr<Direct> direct(new Direct(symbols_));
+    scoped_ptr<Forwards> forwards(new Forwards);
+
+    r::CallRecurser recurser(fnSEXP);
+    recurser.add(direct);
+    recurser.add(forwards);
+    recurser.run();
+
+    // The walk ends at the first direct use, in which case what the
+    // function forwards to no longer matters.
+    pSummary->direct = direct->status();
+    if (!pSummary->direct)
+      pSummary->callees = forwards->callees();
   }
 
-  std::size_t address(SEXP dataSEXP)
+  void propagate()
   {
-    return reinterpret_cast<std::size_t>(dataSEXP);
+    std::vector<index_type> stack;
+    for (index_type i = 0; i < utils::size(nodes_); ++i)
+      if (nodes_[i].status)
+        stack.push_back(i);
+
+    while (!stack.empty())
+    {
+      index_type index = stack.back();
+      stack.pop_back();
+
+      const std::vector<index_type>& callers = nodes_[index].callers;
+      for (index_type i = 0; i < utils::size(callers); ++i)
+      {
+        Node& caller = nodes_[callers[i]];
+        if (caller.status)
+          continue;
+
+        caller.status = true;
+        stack.push_back(callers[i]);
+      }
+    }
   }
 
-  std::map<std::size_t, bool> map_;
+  Database* pDatabase_;
+  detail::Symbols symbols_;
+  std::vector<Node> nodes_;
+  std::map<SEXP, index_type> indices_;
 };
 
-inline Database& database()
+inline bool Database::check(SEXP dataSEXP)
 {
-  static Database instance;
-  return instance;
+  Analysis analysis(this);
+  return analysis.run(dataSEXP);
 }
 
 inline bool performsNonStandardEvaluation(SEXP fnSEXP)
 {
-  return database().check(fnSEXP);
+  Analysis analysis;
+  return analysis.run(fnSEXP);
+}
+
+inline bool performsNonStandardEvaluation(SEXP fnSEXP, Database* pDatabase)
+{
+  return pDatabase->check(fnSEXP);
+}
+
+// Analyze several functions at once, sharing the work done for the
+// functions they have in common.
+inline void performsNonStandardEvaluation(const std::vector<SEXP>& fns,
+                                          Database* pDatabase,
+                                          std::vector<bool>* pResults)
+{
+  Analysis analysis(pDatabase);
+  analysis.run(fns, pResults);
 }
 
 } // namespace nse
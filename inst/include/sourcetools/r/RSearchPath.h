@@ -0,0 +1,187 @@
+#ifndef SOURCETOOLS_R_R_SEARCH_PATH_H
+#define SOURCETOOLS_R_R_SEARCH_PATH_H
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+
+#include <sourcetools/r/RHeaders.h>
+#include <sourcetools/r/RProtect.h>
+#include <sourcetools/r/RUtils.h>
+
+namespace sourcetools {
+namespace r {
+
+// The names of the objects on the search path.
+//
+// Listing every attached environment copies tens of thousands of names,
+// so the names found in the environments attached after the global
+// environment are kept between updates, and only listed again when the
+// search path changes or the names in one of those environments do (as
+// told by a digest of their names, which is much cheaper to compute).
+// The global environment is listed on every update, as its contents
+// change all the time and cannot be tracked cheaply.
+class SearchPathObjects : noncopyable
+{
+public:
+
+  SearchPathObjects()
+    : envsSEXP_(R_NilValue),
+      generation_(0),
+      fingerprintGeneration_(-1),
+      fingerprint_(0)
+  {
+  }
+
+  // Bring the names up to date with the search path. Returns true if
+  // the attached environments had to be listed again.
+  bool update()
+  {
+    std::vector<std::string> global;
+    list(R_GlobalEnv, &global);
+    sortUnique(&global);
+    if (global != global_)
+    {
+      global_.swap(global);
+      ++generation_;
+    }
+
+    std::vector<Entry> entries;
+    for (SEXP envSEXP = parentEnv(R_GlobalEnv);
+         envSEXP != R_EmptyEnv;
+         envSEXP = parentEnv(envSEXP))
+    {
+      // Listing the objects in the base environment means walking the
+      // whole symbol table, and its contents do not change in practice.
+      hash_type names = envSEXP == R_BaseEnv ? 0 : digest(envSEXP);
+      entries.push_back(Entry(envSEXP, names));
+    }
+
+    if (entries == entries_)
+      return false;
+
+    attached_.clear();
+    for (std::vector<Entry>::const_iterator it = entries.begin();
+         it != entries.end();
+         ++it)
+    {
+      list(it->first, &attached_);
+    }
+    sortUnique(&attached_);
+
+    // Keep the environments we were built from alive, so that a new
+    // environment can never be mistaken for a detached one that
+    // happened to live at the same address.
+    Protect protect;
+    SEXP envsSEXP = protect(Rf_allocVector(VECSXP, entries.size()));
+    for (index_type i = 0; i < utils::size(entries); ++i)
+      SET_VECTOR_ELT(envsSEXP, i, entries[i].first);
+
+    R_PreserveObject(envsSEXP);
+    if (envsSEXP_ != R_NilValue)
+      R_ReleaseObject(envsSEXP_);
+    envsSEXP_ = envsSEXP;
+
+    entries_.swap(entries);
+    ++generation_;
+    return true;
+  }
+
+  // A counter that changes whenever the set of names may have changed,
+  // so that results depending on it can tell when they are stale.
+  index_type generation() const
+  {
+    return generation_;
+  }
+
+  // A hash of all the names, for keying results that depend on them.
+  // Computed again only when the generation changes.
+  hash_type fingerprint()
+  {
+    if (fingerprintGeneration_ == generation_)
+      return fingerprint_;
+
+    hash_type result = hash::initial();
+    result = hash::update(result, static_cast<hash_type>(global_.size()));
+    for (index_type i = 0; i < utils::size(global_); ++i)
+      result = hash::update(result, global_[i]);
+    for (index_type i = 0; i < utils::size(attached_); ++i)
+      result = hash::update(result, attached_[i]);
+
+    fingerprint_ = result;
+    fingerprintGeneration_ = generation_;
+    return fingerprint_;
+  }
+
+  bool contains(const std::string& name) const
+  {
+    return std::binary_search(global_.begin(), global_.end(), name) ||
+           std::binary_search(attached_.begin(), attached_.end(), name);
+  }
+
+private:
+
+  typedef std::pair<SEXP, hash_type> Entry;
+
+  // A digest of the names in an environment, independent of their order.
+  // Names are the CHARSXPs printing the symbols bound in the environment,
+  // which live as long as the symbols do, so their addresses identify
+  // them without reading or sorting the strings.
+  static hash_type digest(SEXP envSEXP)
+  {
+    Protect protect;
+    SEXP namesSEXP = protect(listNames(envSEXP));
+
+    R_xlen_t n = Rf_xlength(namesSEXP);
+    hash_type result = hash::update(hash::initial(), static_cast<hash_type>(n));
+    for (R_xlen_t i = 0; i < n; ++i)
+    {
+      std::size_t address = reinterpret_cast<std::size_t>(STRING_ELT(namesSEXP, i));
+      result += hash::update(hash::initial(), static_cast<hash_type>(address));
+    }
+    return result;
+  }
+
+  static void list(SEXP envSEXP, std::vector<std::string>* pNames)
+  {
+    Protect protect;
+    SEXP namesSEXP = protect(listNames(envSEXP));
+    for (R_xlen_t i = 0; i < Rf_length(namesSEXP); ++i)
+    {
+      SEXP charSEXP = STRING_ELT(namesSEXP, i);
+      pNames->push_back(std::string(CHAR(charSEXP), Rf_length(charSEXP)));
+    }
+  }
+
+  static void sortUnique(std::vector<std::string>* pNames)
+  {
+    std::sort(pNames->begin(), pNames->end());
+    pNames->erase(std::unique(pNames->begin(), pNames->end()), pNames->end());
+  }
+
+  std::vector<Entry> entries_;
+  SEXP envsSEXP_;
+  index_type generation_;
+
+  index_type fingerprintGeneration_;
+  hash_type fingerprint_;
+
+  std::vector<std::string> global_;
+  std::vector<std::string> attached_;
+};
+
+// The objects shared by the R entry points. Updating them calls into R,
+// so this is for the main thread only; code running on other threads is
+// handed an up to date instance by const reference instead.
+inline SearchPathObjects& searchPathObjects()
+{
+  static SearchPathObjects instance;
+  return instance;
+}
+
+} // namespace r
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_R_R_SEARCH_PATH_H */
@@ -9,9 +9,70 @@
 #include <sourcetools/r/RProtect.h>
 #include <sourcetools/r/RConverter.h>
 
+#include <Rversion.h>
+
 namespace sourcetools {
 namespace r {
 
+// Allocate a call with 'n' cells (the function and its arguments), to
+// be filled in place.
+inline SEXP allocLang(index_type n)
+{
+#if defined(R_VERSION) && R_VERSION >= R_Version(4, 4, 0)
+  return Rf_allocLang(n);
+#else
+  SEXP langSEXP = Rf_allocList(n);
+  SET_TYPEOF(langSEXP, LANGSXP);
+  return langSEXP;
+#endif
+}
+
+// The enclosing environment of an environment.
+inline SEXP parentEnv(SEXP envSEXP)
+{
+#if defined(R_VERSION) && R_VERSION >= R_Version(4, 5, 0)
+  return R_ParentEnv(envSEXP);
+#else
+  return ENCLOS(envSEXP);
+#endif
+}
+
+// The body of a closure, which may have been compiled, and the
+// environment it was created in.
+inline SEXP closureBody(SEXP fnSEXP)
+{
+#if defined(R_VERSION) && R_VERSION >= R_Version(4, 5, 0)
+  return R_ClosureBody(fnSEXP);
+#else
+  return BODY(fnSEXP);
+#endif
+}
+
+inline SEXP closureEnv(SEXP fnSEXP)
+{
+#if defined(R_VERSION) && R_VERSION >= R_Version(4, 5, 0)
+  return R_ClosureEnv(fnSEXP);
+#else
+  return CLOENV(fnSEXP);
+#endif
+}
+
+// The names bound in an environment (including those starting with a
+// dot), in no particular order. As 'R_lsInternal3()' is no longer part
+// of the API, newer versions of R are asked for 'names(env)' instead.
+inline SEXP listNames(SEXP envSEXP)
+{
+#if defined(R_VERSION) && R_VERSION >= R_Version(4, 5, 0)
+  Protect protect;
+  SEXP callSEXP = protect(Rf_lang2(R_NamesSymbol, envSEXP));
+  return Rf_eval(callSEXP, R_BaseEnv);
+#elif defined(R_VERSION) && R_VERSION >= R_Version(3, 2, 0)
+  return R_lsInternal3(envSEXP, TRUE, FALSE);
+#else
+  return R_lsInternal(envSEXP, TRUE);
+#endif
+}
+
 class RObjectFactory : noncopyable
 {
 public:
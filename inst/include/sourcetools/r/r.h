@@ -5,7 +5,10 @@
 #include <sourcetools/r/RProtect.h>
 #include <sourcetools/r/RUtils.h>
 #include <sourcetools/r/RConverter.h>
+#include <sourcetools/r/RExternalPointer.h>
+#include <sourcetools/r/RAltrep.h>
 #include <sourcetools/r/RFunctions.h>
+#include <sourcetools/r/RSearchPath.h>
 #include <sourcetools/r/RCallRecurser.h>
 #include <sourcetools/r/RNonStandardEvaluation.h>
 
@@ -0,0 +1,152 @@
+#ifndef SOURCETOOLS_READ_MEMORY_MAPPED_LINES_H
+#define SOURCETOOLS_READ_MEMORY_MAPPED_LINES_H
+
+#include <vector>
+#include <cstddef>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/read/MemoryMappedReader.h>
+
+namespace sourcetools {
+namespace detail {
+
+// A file kept memory mapped for its lifetime, together with an index
+// of where each line starts. Lines are only copied out of the mapping
+// when requested, so that reading a handful of lines from a large file
+// costs only the newline scan.
+class MemoryMappedLines : noncopyable
+{
+public:
+
+  explicit MemoryMappedLines(const char* path)
+    : conn_(path),
+      size_(0),
+      pMap_(map(conn_, &size_)),
+      end_(0),
+      lastIndex_(-1),
+      run_(0),
+      sequential_(false)
+  {
+    if (!open() || size_ == 0)
+      return;
+
+    const char* begin = *pMap_;
+    Indexer indexer(begin, &starts_, &end_);
+    MemoryMappedReader::scan_lines(begin, begin + size_, indexer);
+
+    // Access order is unknown until elements are requested.
+    pMap_->adviseRandom();
+  }
+
+  bool open()
+  {
+    if (!conn_.open())
+      return false;
+    return size_ == 0 || (pMap_ != NULL && pMap_->open());
+  }
+
+  std::size_t size() const
+  {
+    return starts_.size();
+  }
+
+  // Get the bounds of line 'i', excluding its line terminator.
+  void line(std::size_t i, const char** pBegin, const char** pEnd) const
+  {
+    const char* data = *pMap_;
+    const char* begin = data + starts_[i];
+    const char* end = data + end_;
+
+    if (i + 1 < starts_.size())
+    {
+      // Lines end with '\n', '\r' or '\r\n'.
+      end = data + starts_[i + 1] - 1;
+      if (end != begin && *end == '\n' && end[-1] == '\r')
+        --end;
+    }
+
+    *pBegin = begin;
+    *pEnd = end;
+
+    access(i);
+  }
+
+private:
+
+  static const int kSequentialThreshold = 64;
+
+  class Indexer
+  {
+  public:
+
+    Indexer(const char* begin,
+            std::vector<std::size_t>* pStarts,
+            std::size_t* pEnd)
+      : begin_(begin), pStarts_(pStarts), pEnd_(pEnd)
+    {
+    }
+
+    void operator()(const char* lower, const char* upper)
+    {
+      pStarts_->push_back(lower - begin_);
+      *pEnd_ = upper - begin_;
+    }
+
+  private:
+    const char* begin_;
+    std::vector<std::size_t>* pStarts_;
+    std::size_t* pEnd_;
+  };
+
+  static MemoryMappedConnection* map(FileConnection& conn, std::size_t* pSize)
+  {
+    if (!conn.open() || !conn.size(pSize) || *pSize == 0)
+      return NULL;
+
+    // Don't pre-fault the whole file; pages are brought in as they
+    // are scanned, and later only as lines are accessed.
+    return new MemoryMappedConnection(conn, *pSize, false);
+  }
+
+  // Track runs of consecutive accesses, asking the kernel to read ahead
+  // once the lines are evidently being walked in order, and to stop
+  // doing so once that pattern breaks.
+  void access(std::size_t i) const
+  {
+    if (static_cast<std::ptrdiff_t>(i) == lastIndex_ + 1)
+    {
+      if (++run_ == kSequentialThreshold && !sequential_)
+      {
+        pMap_->adviseSequential(starts_[i]);
+        sequential_ = true;
+      }
+    }
+    else
+    {
+      run_ = 0;
+      if (sequential_)
+      {
+        pMap_->adviseRandom();
+        sequential_ = false;
+      }
+    }
+
+    lastIndex_ = static_cast<std::ptrdiff_t>(i);
+  }
+
+  FileConnection conn_;
+  std::size_t size_;
+  scoped_ptr<MemoryMappedConnection> pMap_;
+
+  std::vector<std::size_t> starts_;
+  std::size_t end_;
+
+  mutable std::ptrdiff_t lastIndex_;
+  mutable int run_;
+  mutable bool sequential_;
+};
+
+} // namespace detail
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_READ_MEMORY_MAPPED_LINES_H */
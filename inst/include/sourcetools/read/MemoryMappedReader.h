@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 
 #include <sourcetools/core/macros.h>
 
@@ -52,7 +54,7 @@ public:
       return false;
 
     // Get size of file
-    index_type size;
+    std::size_t size;
     if (!conn.size(&size))
       return false;
 
@@ -69,68 +71,97 @@ public:
     return true;
   }
 
-  template <typename F>
-  static bool read_lines(const char* path, F f)
+  // Find the first '\r' or '\n' in [begin, end), returning 'end' if
+  // there is none. The bulk of the range is scanned a word at a time,
+  // testing all bytes in the word for either character at once.
+  static const char* findNewline(const char* begin, const char* end)
   {
-    FileConnection conn(path);
-    if (!conn.open())
-      return false;
+    typedef std::size_t word_type;
 
-    // Get size of file
-    index_type size;
-    if (!conn.size(&size))
-      return false;
+    static const word_type ones = ~word_type(0) / 255;
+    static const word_type highs = ones * 0x80;
+    static const word_type crs = ones * '\r';
+    static const word_type lfs = ones * '\n';
 
-    // Early return for empty files
-    if (UNLIKELY(size == 0))
-      return true;
+    const char* it = begin;
+    while (static_cast<std::size_t>(end - it) >= sizeof(word_type))
+    {
+      word_type word;
+      std::memcpy(&word, it, sizeof(word_type));
 
-    // mmap the file
-    MemoryMappedConnection map(conn, size);
-    if (!map.open())
-      return false;
+      word_type cr = word ^ crs;
+      word_type lf = word ^ lfs;
+      if (((cr - ones) & ~cr & highs) || ((lf - ones) & ~lf & highs))
+        break;
 
-    // special case: just a '\n'
-    bool endsWithNewline =
-      map[size - 1] == '\n' ||
-      map[size - 1] == '\r';
-    
-    if (size == 1 && endsWithNewline)
-      return true;
+      it += sizeof(word_type);
+    }
+
+    for (; it != end; ++it)
+      if (*it == '\r' || *it == '\n')
+        return it;
 
-    // Search for newlines
-    const char* lower = map;
-    const char* end = map + size;
-    
-    for (const char* it = lower; it != end; it++)
+    return end;
+  }
+
+  // Invoke 'f(lower, upper)' for each line in [begin, end).
+  template <typename F>
+  static void scan_lines(const char* begin, const char* end, F& f)
+  {
+    if (begin == end)
+      return;
+
+    // special case: just a '\n'
+    bool endsWithNewline = end[-1] == '\n' || end[-1] == '\r';
+    if (end - begin == 1 && endsWithNewline)
+      return;
+
+    const char* lower = begin;
+    for (const char* it = findNewline(lower, end);
+         it != end;
+         it = findNewline(lower, end))
     {
-      // check for newline
-      char ch = *it;
-      bool isNewline = ch == '\r' || ch == '\n';
-      if (!isNewline)
-        continue;
-      
       // found a newline; call functor
       f(lower, it);
-      
+
       // update iterator, handling '\r\n' specially
-      if (it[0] == '\r' &&
-          it[1] == '\n')
-      {
+      if (it[0] == '\r' && it + 1 != end && it[1] == '\n')
         it += 1;
-      }
-      
+
       // update lower iterator
       lower = it + 1;
-      
     }
 
     // If this file ended with a newline, we're done
     if (endsWithNewline)
-      return true;
+      return;
 
     // Otherwise, consume one more string, then we're done
     f(lower, end);
+  }
+
+  template <typename F>
+  static bool read_lines(const char* path, F f)
+  {
+    FileConnection conn(path);
+    if (!conn.open())
+      return false;
+
+    // Get size of file
+    std::size_t size;
+    if (!conn.size(&size))
+      return false;
+
+    // Early return for empty files
+    if (UNLIKELY(size == 0))
+      return true;
+
+    // mmap the file
+    MemoryMappedConnection map(conn, size);
+    if (!map.open())
+      return false;
+
+    scan_lines(map, map + size, f);
     return true;
   }
 
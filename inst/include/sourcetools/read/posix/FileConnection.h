@@ -32,7 +32,8 @@ public:
     return fd_ != -1;
   }
 
-  bool size(index_type* pSize)
+  template <typename T>
+  bool size(T* pSize)
   {
     struct stat info;
     if (::fstat(fd_, &info) == -1)
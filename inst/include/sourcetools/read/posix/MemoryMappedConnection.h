@@ -2,7 +2,9 @@
 #define SOURCETOOLS_READ_POSIX_MEMORY_MAPPED_CONNECTION_H
 
 #include <cstdlib>
+#include <cstddef>
 #include <fcntl.h>
+#include <unistd.h>
 #include <sys/mman.h>
 
 #include <sourcetools/platform/platform.h>
@@ -14,17 +16,38 @@ class MemoryMappedConnection
 {
 public:
 
-  MemoryMappedConnection(int fd, index_type size)
+  MemoryMappedConnection(int fd, std::size_t size, bool populate = true)
     : size_(size)
   {
 #ifdef MAP_POPULATE
-    map_ = (char*) ::mmap(0, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+    int flags = populate ? MAP_SHARED | MAP_POPULATE : MAP_SHARED;
 #else
-    map_ = (char*) ::mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    int flags = MAP_SHARED;
 #endif
 
+    map_ = (char*) ::mmap(0, size, PROT_READ, flags, fd, 0);
+
 #if defined(POSIX_MADV_SEQUENTIAL) && defined(POSIX_MADV_WILLNEED)
-    ::posix_madvise((void*) map_, size, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+    if (populate && map_ != MAP_FAILED)
+      ::posix_madvise((void*) map_, size, POSIX_MADV_SEQUENTIAL | POSIX_MADV_WILLNEED);
+#endif
+  }
+
+  // Hint that the mapping, starting at 'offset', will be read
+  // sequentially from here on.
+  void adviseSequential(std::size_t offset = 0)
+  {
+#ifdef POSIX_MADV_SEQUENTIAL
+    advise(offset, POSIX_MADV_SEQUENTIAL);
+#endif
+  }
+
+  // Hint that the mapping will be accessed in random order, so that
+  // the kernel doesn't bother reading ahead.
+  void adviseRandom()
+  {
+#ifdef POSIX_MADV_RANDOM
+    advise(0, POSIX_MADV_RANDOM);
 #endif
   }
 
@@ -45,8 +68,20 @@ public:
   }
 
 private:
+
+  void advise(std::size_t offset, int advice)
+  {
+    if (map_ == MAP_FAILED || offset >= size_)
+      return;
+
+    // Align the start of the advised region to a page boundary.
+    std::size_t pageSize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t start = offset - offset % pageSize;
+    ::posix_madvise((void*) (map_ + start), size_ - start, advice);
+  }
+
   char* map_;
-  index_type size_;
+  std::size_t size_;
 };
 
 } // namespace detail
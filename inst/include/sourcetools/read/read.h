@@ -5,6 +5,7 @@
 #include <string>
 
 #include <sourcetools/read/MemoryMappedReader.h>
+#include <sourcetools/read/MemoryMappedLines.h>
 
 namespace sourcetools {
 
@@ -29,9 +29,14 @@ public:
     return handle_ != INVALID_HANDLE_VALUE;
   }
 
-  bool size(index_type* pSize)
+  template <typename T>
+  bool size(T* pSize)
   {
-    *pSize = ::GetFileSize(handle_, NULL);
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(handle_, &size))
+      return false;
+
+    *pSize = static_cast<T>(size.QuadPart);
     return true;
   }
 
@@ -6,6 +6,8 @@
 
 #include <windows.h>
 
+#include <cstddef>
+
 #include <sourcetools/core/core.h>
 
 namespace sourcetools {
@@ -15,7 +17,7 @@ class MemoryMappedConnection
 {
 public:
 
-  MemoryMappedConnection(HANDLE handle, index_type size)
+  MemoryMappedConnection(HANDLE handle, std::size_t size, bool populate = true)
     : map_(NULL), size_(size)
   {
     handle_ = ::CreateFileMapping(handle, NULL, PAGE_READONLY, 0, 0, NULL);
@@ -39,6 +41,10 @@ public:
     return map_ != NULL;
   }
 
+  // Access pattern hints are not used on Windows.
+  void adviseSequential(std::size_t offset = 0) {}
+  void adviseRandom() {}
+
   operator char*() const
   {
     return map_;
@@ -46,7 +52,7 @@ public:
 
 private:
   char* map_;
-  index_type size_;
+  std::size_t size_;
   HANDLE handle_;
 };
 
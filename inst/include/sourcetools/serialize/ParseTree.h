@@ -0,0 +1,740 @@
+#ifndef SOURCETOOLS_SERIALIZE_PARSE_TREE_H
+#define SOURCETOOLS_SERIALIZE_PARSE_TREE_H
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/tokenization/tokenization.h>
+#include <sourcetools/parse/ParseNode.h>
+#include <sourcetools/parse/ParseError.h>
+#include <sourcetools/read/read.h>
+#include <sourcetools/serialize/Varint.h>
+
+namespace sourcetools {
+namespace serialize {
+
+// A binary format for a parsed document: its source, token stream, parse
+// tree and parse errors. Everything is stored as offsets, counts and
+// indices (never addresses), so a serialized document can be read back
+// in another process or on another machine. The layout is:
+//
+//    magic          "SRCPARSE"
+//    format         varint
+//    source         varint length, then bytes
+//    types          varint count, then a varint per distinct token type
+//    tokens         varint count; for each token, its index in the
+//                   types and its layout, then its size. Tokens are
+//                   usually contiguous, and either continue the row of
+//                   the previous token or begin a later one, in which
+//                   case only the number of rows advanced is written;
+//                   otherwise, the gap since the previous token and the
+//                   token's row and column are written out.
+//    strings        varint count, then each as varint length and bytes
+//    errors         varint count; for each, the index of its message in
+//                   the strings, then its start and end row and column
+//    nodes          varint count; for each node, in pre-order: its
+//                   number of children (with flags for whether its first
+//                   and last tokens differ from its own token), then a
+//                   reference to its token, and to its first and last
+//                   tokens where they differ
+//
+// Tokens referenced by nodes are usually in the token stream, and are
+// written as the signed distance from the previously referenced index.
+// Tokens without a source location (e.g. for missing arguments) and any
+// not found in the stream are written out in full.
+namespace detail {
+
+inline const char* magic() { return "SRCPARSE"; }
+inline std::size_t magicSize() { return 8; }
+inline uint32_t format() { return 1; }
+
+enum TokenLayout
+{
+  LAYOUT_SAME_ROW,
+  LAYOUT_NEW_ROW,
+  LAYOUT_EXPLICIT
+};
+
+enum TokenReference
+{
+  REFERENCE_SYNTHETIC,
+  REFERENCE_STREAM,
+  REFERENCE_EXPLICIT
+};
+
+// The number of children the parser gives nodes of each type. Trees
+// with parse errors may hold nodes with fewer children (e.g. an operator
+// missing its operands), but never more. Any token may also stand,
+// childless, as the name of an argument, i.e. as the first child of '='.
+inline void childCounts(const tokens::Token& token, index_type* pMin, index_type* pMax)
+{
+  using namespace tokens;
+
+  static const index_type unbounded = -1;
+
+  *pMin = 0;
+  *pMax = 0;
+  switch (token.type())
+  {
+  case ROOT:
+  case EMPTY:
+    *pMax = unbounded;
+    return;
+  case LPAREN:
+  case LBRACE:
+    *pMin = 1;
+    *pMax = unbounded;
+    return;
+  case LBRACKET:
+  case LDBRACKET:
+    *pMin = 2;
+    *pMax = unbounded;
+    return;
+  case KEYWORD_FUNCTION:
+  case KEYWORD_WHILE:
+    *pMin = *pMax = 2;
+    return;
+  case KEYWORD_IF:
+    *pMin = 2;
+    *pMax = 3;
+    return;
+  case KEYWORD_FOR:
+    *pMin = *pMax = 3;
+    return;
+  case KEYWORD_REPEAT:
+    *pMin = *pMax = 1;
+    return;
+  default:
+    break;
+  }
+
+  if (isOperator(token))
+  {
+    *pMin = isUnaryOperator(token) ? 1 : 2;
+    *pMax = 2;
+  }
+}
+
+} // namespace detail
+
+class ParseTreeWriter
+{
+  typedef tokens::Token Token;
+  typedef tokens::TokenType TokenType;
+  typedef parser::ParseNode ParseNode;
+
+public:
+
+  ParseTreeWriter(const char* code, index_type n)
+    : code_(code), n_(n), previous_(0)
+  {
+    Token token;
+    tokenizer::Tokenizer tokenizer(code, n);
+    while (n > 0 && tokenizer.tokenize(&token))
+      tokens_.push_back(token);
+  }
+
+  void write(const ParseNode* pRoot,
+             const std::vector<parser::ParseError>& errors,
+             std::string* pBuffer)
+  {
+    // List the nodes in pre-order, and the token types used throughout,
+    // so that the type table can be written ahead of everything else.
+    std::vector<const ParseNode*> nodes;
+    std::vector<const ParseNode*> stack(1, pRoot);
+    while (!stack.empty())
+    {
+      const ParseNode* pNode = stack.back();
+      stack.pop_back();
+      nodes.push_back(pNode);
+
+      const std::vector<ParseNode*>& children = pNode->children();
+      stack.insert(stack.end(), children.rbegin(), children.rend());
+
+      addType(pNode->token().type());
+      addType(pNode->begin().type());
+      addType(pNode->end().type());
+    }
+
+    for (index_type i = 0; i < utils::size(tokens_); ++i)
+      addType(tokens_[i].type());
+
+    VarintWriter writer(pBuffer);
+    writer.writeRaw(detail::magic(), detail::magicSize());
+    writer.write(detail::format());
+    writer.writeBytes(code_, n_);
+
+    writer.write(static_cast<uint32_t>(types_.size()));
+    for (index_type i = 0; i < utils::size(types_); ++i)
+      writer.write(types_[i]);
+
+    writeTokens(&writer);
+
+    writer.write(static_cast<uint32_t>(errors.size()));
+    for (index_type i = 0; i < utils::size(errors); ++i)
+      writer.writeBytes(errors[i].message().data(), errors[i].message().size());
+
+    writer.write(static_cast<uint32_t>(errors.size()));
+    for (index_type i = 0; i < utils::size(errors); ++i)
+    {
+      const parser::ParseError& error = errors[i];
+      writer.write(static_cast<uint32_t>(i));
+      writer.writeSigned(error.start().row);
+      writer.writeSigned(error.start().column);
+      writer.writeSigned(error.end().row);
+      writer.writeSigned(error.end().column);
+    }
+
+    writer.write(static_cast<uint32_t>(nodes.size()));
+    for (index_type i = 0; i < utils::size(nodes); ++i)
+    {
+      // The first and last tokens of most nodes (e.g. all leaves) are
+      // the node's own token, and are then not written again.
+      const ParseNode* pNode = nodes[i];
+      bool begin = !same(pNode->begin(), pNode->token());
+      bool end = !same(pNode->end(), pNode->token());
+
+      uint32_t children = static_cast<uint32_t>(pNode->children().size());
+      writer.write((children << 2) | (begin ? 1 : 0) | (end ? 2 : 0));
+      writeReference(&writer, pNode->token());
+      if (begin)
+        writeReference(&writer, pNode->begin());
+      if (end)
+        writeReference(&writer, pNode->end());
+    }
+  }
+
+private:
+
+  void addType(TokenType type)
+  {
+    if (typeIndices_.insert(std::make_pair(type, utils::size(types_))).second)
+      types_.push_back(type);
+  }
+
+  uint32_t typeIndex(TokenType type) const
+  {
+    return static_cast<uint32_t>(typeIndices_.find(type)->second);
+  }
+
+  void writeTokens(VarintWriter* pWriter)
+  {
+    using namespace detail;
+
+    pWriter->write(static_cast<uint32_t>(tokens_.size()));
+
+    index_type end = 0, row = 0, column = 0;
+    for (index_type i = 0; i < utils::size(tokens_); ++i)
+    {
+      const Token& token = tokens_[i];
+      uint32_t type = typeIndex(token.type()) << 2;
+
+      if (token.offset() == end && token.row() == row && token.column() == column)
+      {
+        pWriter->write(type | LAYOUT_SAME_ROW);
+      }
+      else if (token.offset() == end && token.row() > row && token.column() == 0)
+      {
+        pWriter->write(type | LAYOUT_NEW_ROW);
+        pWriter->write(static_cast<uint32_t>(token.row() - row));
+      }
+      else
+      {
+        pWriter->write(type | LAYOUT_EXPLICIT);
+        pWriter->write(static_cast<uint32_t>(token.offset() - end));
+        pWriter->write(static_cast<uint32_t>(token.row()));
+        pWriter->write(static_cast<uint32_t>(token.column()));
+      }
+
+      pWriter->write(static_cast<uint32_t>(token.size()));
+
+      end = token.offset() + token.size();
+      row = token.row();
+      column = token.column() + token.size();
+    }
+  }
+
+  static bool same(const Token& lhs, const Token& rhs)
+  {
+    return lhs.offset() == rhs.offset() &&
+           lhs.size() == rhs.size() &&
+           lhs.type() == rhs.type() &&
+           lhs.position() == rhs.position();
+  }
+
+  static bool compareOffset(const Token& token, index_type offset)
+  {
+    return token.offset() < offset;
+  }
+
+  // The index of 'token' in the token stream, or -1 if it isn't there.
+  index_type find(const Token& token) const
+  {
+    std::vector<Token>::const_iterator it = std::lower_bound(
+      tokens_.begin(), tokens_.end(), token.offset(), compareOffset);
+
+    if (it == tokens_.end() || !same(*it, token))
+      return -1;
+
+    return it - tokens_.begin();
+  }
+
+  void writeReference(VarintWriter* pWriter, const Token& token)
+  {
+    using namespace detail;
+
+    if (token.offset() == -1)
+    {
+      pWriter->write((typeIndex(token.type()) << 2) | REFERENCE_SYNTHETIC);
+      return;
+    }
+
+    index_type index = find(token);
+    if (index != -1)
+    {
+      pWriter->write((zigzag(index - previous_) << 2) | REFERENCE_STREAM);
+      previous_ = index;
+      return;
+    }
+
+    pWriter->write((typeIndex(token.type()) << 2) | REFERENCE_EXPLICIT);
+    pWriter->write(static_cast<uint32_t>(token.offset()));
+    pWriter->write(static_cast<uint32_t>(token.size()));
+    pWriter->write(static_cast<uint32_t>(token.row()));
+    pWriter->write(static_cast<uint32_t>(token.column()));
+  }
+
+  const char* code_;
+  index_type n_;
+
+  std::vector<Token> tokens_;
+  std::vector<TokenType> types_;
+  std::map<TokenType, index_type> typeIndices_;
+  index_type previous_;
+};
+
+// Serialize the parse tree of 'code', as found by the parser.
+inline void write(const char* code,
+                  index_type n,
+                  const parser::ParseNode* pRoot,
+                  const std::vector<parser::ParseError>& errors,
+                  std::string* pBuffer)
+{
+  ParseTreeWriter writer(code, n);
+  writer.write(pRoot, errors, pBuffer);
+}
+
+// A parse tree read back from its serialized form. The source text is
+// not copied: tokens point into the serialized data, which must outlive
+// the tree, unless it was read from a file, in which case the file stays
+// memory mapped for as long as the tree is alive.
+class ParseTree : noncopyable
+{
+  typedef tokens::Token Token;
+  typedef tokens::TokenType TokenType;
+  typedef parser::ParseNode ParseNode;
+  typedef collections::Position Position;
+
+public:
+
+  ParseTree()
+    : code_(NULL), n_(0), pRoot_(NULL), pConnection_(NULL), pMap_(NULL)
+  {
+  }
+
+  ~ParseTree()
+  {
+    delete pRoot_;
+  }
+
+  bool read(const std::string& path)
+  {
+    scoped_ptr<sourcetools::detail::FileConnection> pConnection(
+      new sourcetools::detail::FileConnection(path.c_str()));
+    if (!pConnection->open())
+      return false;
+
+    std::size_t size;
+    if (!pConnection->size(&size) || size == 0)
+      return false;
+
+    scoped_ptr<sourcetools::detail::MemoryMappedConnection> pMap(
+      new sourcetools::detail::MemoryMappedConnection(*pConnection, size));
+    if (!pMap->open())
+      return false;
+
+    if (!read(*pMap, size))
+      return false;
+
+    pConnection_.reset(pConnection.release());
+    pMap_.reset(pMap.release());
+    return true;
+  }
+
+  bool read(const char* data, std::size_t size)
+  {
+    delete pRoot_;
+    pRoot_ = NULL;
+    tokens_.clear();
+    errors_.clear();
+
+    VarintReader reader(data, data + size);
+    if (!reader.readRaw(detail::magic(), detail::magicSize()))
+      return false;
+
+    uint32_t format;
+    if (!reader.read(&format) || format != detail::format())
+      return false;
+
+    if (!reader.readBytes(&code_, &n_))
+      return false;
+
+    if (!readTypes(&reader) ||
+        !readTokens(&reader) ||
+        !readErrors(&reader) ||
+        !readNodes(&reader))
+    {
+      delete pRoot_;
+      pRoot_ = NULL;
+      return false;
+    }
+
+    return reader.done();
+  }
+
+  const char* code() const { return code_; }
+  index_type size() const { return n_; }
+
+  const std::vector<Token>& tokens() const { return tokens_; }
+  const std::vector<parser::ParseError>& errors() const { return errors_; }
+
+  const ParseNode* root() const { return pRoot_; }
+
+  // Take ownership of the tree. The tree still refers to the source
+  // held by this object (or by the caller), so it must not outlive it.
+  ParseNode* release()
+  {
+    ParseNode* pRoot = pRoot_;
+    pRoot_ = NULL;
+    return pRoot;
+  }
+
+private:
+
+  bool readTypes(VarintReader* pReader)
+  {
+    index_type n;
+    if (!pReader->read(&n))
+      return false;
+
+    types_.clear();
+    for (index_type i = 0; i < n; ++i)
+    {
+      uint32_t type;
+      if (!pReader->read(&type))
+        return false;
+      types_.push_back(type);
+    }
+
+    return true;
+  }
+
+  bool readType(VarintReader* pReader, TokenType* pType) const
+  {
+    index_type index;
+    return pReader->read(&index) && type(index, pType);
+  }
+
+  bool type(index_type index, TokenType* pType) const
+  {
+    if (index >= utils::size(types_))
+      return false;
+
+    *pType = types_[index];
+    return true;
+  }
+
+  bool token(index_type offset,
+             index_type size,
+             const Position& position,
+             TokenType type,
+             Token* pToken) const
+  {
+    if (offset < 0 || size < 0 || offset > n_ || size > n_ - offset)
+      return false;
+
+    *pToken = Token(code_, offset, size, position, type);
+    return true;
+  }
+
+  bool readTokens(VarintReader* pReader)
+  {
+    using namespace detail;
+
+    index_type n;
+    if (!pReader->read(&n))
+      return false;
+
+    index_type end = 0, row = 0, column = 0;
+    for (index_type i = 0; i < n; ++i)
+    {
+      uint32_t header;
+      TokenType type;
+      if (!pReader->read(&header) || !this->type(header >> 2, &type))
+        return false;
+
+      index_type offset = end;
+      switch (header & 3)
+      {
+      case LAYOUT_SAME_ROW:
+        break;
+      case LAYOUT_NEW_ROW:
+      {
+        index_type rows;
+        if (!pReader->read(&rows) || rows == 0)
+          return false;
+        row += rows;
+        column = 0;
+        break;
+      }
+      case LAYOUT_EXPLICIT:
+      {
+        index_type gap;
+        if (!pReader->read(&gap) ||
+            gap > n_ - end ||
+            !pReader->read(&row) ||
+            !pReader->read(&column))
+        {
+          return false;
+        }
+        offset += gap;
+        break;
+      }
+      default:
+        return false;
+      }
+
+      index_type size;
+      Token token;
+      if (!pReader->read(&size) ||
+          !this->token(offset, size, Position(row, column), type, &token))
+      {
+        return false;
+      }
+
+      tokens_.push_back(token);
+      end = offset + size;
+      column += size;
+    }
+
+    return true;
+  }
+
+  bool readErrors(VarintReader* pReader)
+  {
+    index_type n;
+    if (!pReader->read(&n))
+      return false;
+
+    std::vector<std::string> strings;
+    for (index_type i = 0; i < n; ++i)
+    {
+      const char* data;
+      index_type size;
+      if (!pReader->readBytes(&data, &size))
+        return false;
+      strings.push_back(std::string(data, size));
+    }
+
+    if (!pReader->read(&n))
+      return false;
+
+    for (index_type i = 0; i < n; ++i)
+    {
+      index_type message;
+      int32_t startRow, startColumn, endRow, endColumn;
+      if (!pReader->read(&message) ||
+          message >= utils::size(strings) ||
+          !pReader->readSigned(&startRow) ||
+          !pReader->readSigned(&startColumn) ||
+          !pReader->readSigned(&endRow) ||
+          !pReader->readSigned(&endColumn))
+      {
+        return false;
+      }
+
+      errors_.push_back(parser::ParseError(
+        Position(startRow, startColumn),
+        Position(endRow, endColumn),
+        strings[message]));
+    }
+
+    return true;
+  }
+
+  // The types of the tokens the parser creates without a location; a
+  // token of any other type (e.g. a symbol) must have one.
+  static bool synthetic(TokenType type)
+  {
+    using namespace tokens;
+    return type == EMPTY || type == MISSING || type == ROOT ||
+           type == END || type == INVALID;
+  }
+
+  bool readReference(VarintReader* pReader, index_type* pPrevious, Token* pToken) const
+  {
+    using namespace detail;
+
+    uint32_t value;
+    if (!pReader->read(&value))
+      return false;
+
+    uint32_t payload = value >> 2;
+    switch (value & 3)
+    {
+
+    case REFERENCE_SYNTHETIC:
+    {
+      TokenType type;
+      if (!this->type(payload, &type) || !synthetic(type))
+        return false;
+
+      *pToken = Token(type);
+      return true;
+    }
+
+    case REFERENCE_STREAM:
+    {
+      index_type index = *pPrevious + unzigzag(payload);
+      if (index < 0 || index >= utils::size(tokens_))
+        return false;
+
+      *pToken = tokens_[index];
+      *pPrevious = index;
+      return true;
+    }
+
+    case REFERENCE_EXPLICIT:
+    {
+      TokenType type;
+      index_type offset, size, row, column;
+      return this->type(payload, &type) &&
+        pReader->read(&offset) &&
+        pReader->read(&size) &&
+        pReader->read(&row) &&
+        pReader->read(&column) &&
+        this->token(offset, size, Position(row, column), type, pToken);
+    }
+
+    }
+
+    return false;
+  }
+
+  // Whether a node could have been built by the parser with the given
+  // number of children, so that code walking the tree can rely on its
+  // shape. The nodes on the stack are those still waiting for children,
+  // the last being the new node's parent.
+  bool validChildCount(const Token& token,
+                       index_type children,
+                       const std::vector< std::pair<ParseNode*, index_type> >& stack) const
+  {
+    index_type min, max;
+    detail::childCounts(token, &min, &max);
+    if (max != -1 && children > max)
+      return false;
+
+    if (children >= min || !errors_.empty())
+      return true;
+
+    // The name of an argument.
+    if (children == 0 && !stack.empty())
+    {
+      const ParseNode* pParent = stack.back().first;
+      return pParent->token().isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS) &&
+             pParent->children().empty();
+    }
+
+    return false;
+  }
+
+  bool readNodes(VarintReader* pReader)
+  {
+    index_type n;
+    if (!pReader->read(&n) || n == 0)
+      return false;
+
+    // Each entry is a node still waiting for some of its children.
+    std::vector< std::pair<ParseNode*, index_type> > stack;
+    index_type previous = 0;
+
+    for (index_type i = 0; i < n; ++i)
+    {
+      uint32_t header;
+      Token token;
+      if (!pReader->read(&header) ||
+          !readReference(pReader, &previous, &token))
+      {
+        return false;
+      }
+
+      index_type children = static_cast<index_type>(header >> 2);
+      if (children > n - i - 1)
+        return false;
+
+      if (!validChildCount(token, children, stack))
+        return false;
+
+      Token begin = token, end = token;
+      if ((header & 1) && !readReference(pReader, &previous, &begin))
+        return false;
+      if ((header & 2) && !readReference(pReader, &previous, &end))
+        return false;
+
+      ParseNode* pNode = ParseNode::create(token);
+      pNode->setLocalBegin(begin);
+      pNode->setLocalEnd(end);
+
+      if (stack.empty())
+      {
+        if (pRoot_ != NULL)
+        {
+          delete pNode;
+          return false;
+        }
+        pRoot_ = pNode;
+      }
+      else
+      {
+        stack.back().first->append(pNode);
+        if (--stack.back().second == 0)
+          stack.pop_back();
+      }
+
+      if (children > 0)
+        stack.push_back(std::make_pair(pNode, children));
+    }
+
+    return stack.empty();
+  }
+
+  const char* code_;
+  index_type n_;
+
+  std::vector<TokenType> types_;
+  std::vector<Token> tokens_;
+  std::vector<parser::ParseError> errors_;
+  ParseNode* pRoot_;
+
+  scoped_ptr<sourcetools::detail::FileConnection> pConnection_;
+  scoped_ptr<sourcetools::detail::MemoryMappedConnection> pMap_;
+};
+
+} // namespace serialize
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_SERIALIZE_PARSE_TREE_H */
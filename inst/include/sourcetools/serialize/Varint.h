@@ -0,0 +1,162 @@
+#ifndef SOURCETOOLS_SERIALIZE_VARINT_H
+#define SOURCETOOLS_SERIALIZE_VARINT_H
+
+#include <cstddef>
+#include <string>
+
+#include <stdint.h>
+
+#include <sourcetools/core/core.h>
+
+namespace sourcetools {
+namespace serialize {
+
+// Map signed integers to unsigned ones, interleaving negative and
+// positive values (0, -1, 1, -2, ...) so that those close to zero stay
+// small either way ("zig-zag" encoding).
+inline uint32_t zigzag(int32_t value)
+{
+  return (static_cast<uint32_t>(value) << 1) ^ (value < 0 ? 0xffffffffu : 0u);
+}
+
+inline int32_t unzigzag(uint32_t bits)
+{
+  return static_cast<int32_t>((bits >> 1) ^ (0u - (bits & 1)));
+}
+
+// Unsigned integers are written seven bits at a time, least significant
+// first, with the high bit of each byte set when more follow; small
+// values (the common case for lengths and deltas) take a single byte.
+// Signed integers are zig-zag encoded first.
+class VarintWriter
+{
+public:
+
+  explicit VarintWriter(std::string* pBuffer)
+    : pBuffer_(pBuffer)
+  {
+  }
+
+  void write(uint32_t value)
+  {
+    while (value >= 0x80)
+    {
+      pBuffer_->push_back(static_cast<char>((value & 0x7f) | 0x80));
+      value >>= 7;
+    }
+    pBuffer_->push_back(static_cast<char>(value));
+  }
+
+  void writeSigned(int32_t value)
+  {
+    write(zigzag(value));
+  }
+
+  void writeBytes(const char* data, std::size_t n)
+  {
+    write(static_cast<uint32_t>(n));
+    pBuffer_->append(data, n);
+  }
+
+  void writeRaw(const char* data, std::size_t n)
+  {
+    pBuffer_->append(data, n);
+  }
+
+private:
+  std::string* pBuffer_;
+};
+
+// Reads values written by a VarintWriter from a buffer it does not own.
+// Reads fail, rather than run past the end of the buffer, on truncated
+// or malformed input.
+class VarintReader
+{
+public:
+
+  VarintReader(const char* begin, const char* end)
+    : pos_(begin), end_(end)
+  {
+  }
+
+  bool read(uint32_t* pValue)
+  {
+    uint32_t value = 0;
+    for (index_type shift = 0; shift < 35; shift += 7)
+    {
+      if (pos_ == end_)
+        return false;
+
+      unsigned char byte = static_cast<unsigned char>(*pos_++);
+      value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0)
+      {
+        *pValue = value;
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Read a value that must fit in a (non-negative) index_type.
+  bool read(index_type* pValue)
+  {
+    uint32_t value;
+    if (!read(&value) || value > 0x7fffffffu)
+      return false;
+
+    *pValue = static_cast<index_type>(value);
+    return true;
+  }
+
+  bool readSigned(int32_t* pValue)
+  {
+    uint32_t bits;
+    if (!read(&bits))
+      return false;
+
+    *pValue = unzigzag(bits);
+    return true;
+  }
+
+  // Point at the next 'n' bytes of the buffer, without copying them.
+  bool readBytes(const char** pData, index_type* pSize)
+  {
+    index_type n;
+    if (!read(&n) || end_ - pos_ < n)
+      return false;
+
+    *pData = pos_;
+    *pSize = n;
+    pos_ += n;
+    return true;
+  }
+
+  bool readRaw(const char* expected, std::size_t n)
+  {
+    if (static_cast<std::size_t>(end_ - pos_) < n)
+      return false;
+
+    for (std::size_t i = 0; i < n; ++i)
+      if (pos_[i] != expected[i])
+        return false;
+
+    pos_ += n;
+    return true;
+  }
+
+  bool done() const
+  {
+    return pos_ == end_;
+  }
+
+private:
+  const char* pos_;
+  const char* end_;
+};
+
+} // namespace serialize
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_SERIALIZE_VARINT_H */
@@ -0,0 +1,7 @@
+#ifndef SOURCETOOLS_SERIALIZE_SERIALIZE_H
+#define SOURCETOOLS_SERIALIZE_SERIALIZE_H
+
+#include <sourcetools/serialize/Varint.h>
+#include <sourcetools/serialize/ParseTree.h>
+
+#endif /* SOURCETOOLS_SERIALIZE_SERIALIZE_H */
@@ -0,0 +1,17 @@
+#ifndef SOURCETOOLS_THREAD_RUNNABLE_H
+#define SOURCETOOLS_THREAD_RUNNABLE_H
+
+namespace sourcetools {
+namespace detail {
+
+class Runnable
+{
+public:
+  virtual void run() = 0;
+  virtual ~Runnable() {}
+};
+
+} // namespace detail
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_THREAD_RUNNABLE_H */
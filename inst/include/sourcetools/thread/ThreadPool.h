@@ -0,0 +1,183 @@
+#ifndef SOURCETOOLS_THREAD_THREAD_POOL_H
+#define SOURCETOOLS_THREAD_THREAD_POOL_H
+
+#include <algorithm>
+#include <vector>
+
+#include <sourcetools/core/core.h>
+
+#ifndef _WIN32
+# include <sourcetools/thread/posix/Thread.h>
+#else
+# include <sourcetools/thread/windows/Thread.h>
+#endif
+
+namespace sourcetools {
+namespace thread {
+
+// A unit of work applied to each index of a parallel loop. Each thread
+// is given its own worker, so workers need no locking of their own, but
+// they must not call into R.
+class Worker
+{
+public:
+  virtual void operator()(index_type i) = 0;
+  virtual ~Worker() {}
+};
+
+namespace detail {
+
+class Queue : noncopyable
+{
+public:
+
+  explicit Queue(index_type n)
+    : next_(0), n_(n), failed_(false)
+  {
+  }
+
+  // Take the next index to work on, or -1 when none are left.
+  index_type take()
+  {
+    mutex_.lock();
+    index_type i = next_ < n_ && !failed_ ? next_++ : -1;
+    mutex_.unlock();
+    return i;
+  }
+
+  void fail()
+  {
+    mutex_.lock();
+    failed_ = true;
+    mutex_.unlock();
+  }
+
+  bool failed() const
+  {
+    return failed_;
+  }
+
+private:
+  sourcetools::detail::Mutex mutex_;
+  index_type next_;
+  index_type n_;
+  bool failed_;
+};
+
+class Runner : public sourcetools::detail::Runnable
+{
+public:
+
+  Runner(Queue* pQueue, Worker* pWorker)
+    : pQueue_(pQueue), pWorker_(pWorker)
+  {
+  }
+
+  void run()
+  {
+    try
+    {
+      for (index_type i = pQueue_->take(); i != -1; i = pQueue_->take())
+        (*pWorker_)(i);
+    }
+    catch (...)
+    {
+      pQueue_->fail();
+    }
+  }
+
+private:
+  Queue* pQueue_;
+  Worker* pWorker_;
+};
+
+} // namespace detail
+
+// Apply the workers to the indices [0, n), handing the next index to
+// whichever thread becomes free first. The first worker runs on the
+// calling thread, and every other one on a thread of its own; should a
+// thread fail to start, the remaining threads pick up its share.
+// Returns false if a worker threw, in which case some indices may not
+// have been visited.
+inline bool parallelFor(index_type n, const std::vector<Worker*>& workers)
+{
+  // Give threads the stack size R itself is usually run with.
+  static const std::size_t kStackSize = 8 * 1024 * 1024;
+
+  detail::Queue queue(n);
+
+  std::vector<detail::Runner> runners;
+  for (index_type i = 0; i < utils::size(workers); ++i)
+    runners.push_back(detail::Runner(&queue, workers[i]));
+
+  std::vector<sourcetools::detail::Thread*> threads;
+  for (index_type i = 1; i < utils::size(runners); ++i)
+  {
+    sourcetools::detail::Thread* pThread = new sourcetools::detail::Thread(&runners[i]);
+    if (!pThread->start(kStackSize))
+    {
+      delete pThread;
+      break;
+    }
+    threads.push_back(pThread);
+  }
+
+  if (!runners.empty())
+    runners[0].run();
+
+  for (index_type i = 0; i < utils::size(threads); ++i)
+  {
+    threads[i]->join();
+    delete threads[i];
+  }
+
+  return !queue.failed();
+}
+
+inline index_type hardwareConcurrency()
+{
+  return sourcetools::detail::Thread::hardwareConcurrency();
+}
+
+// Run a loop over [0, n) on 'threads' threads: one per core when
+// 'threads' is not positive, and never more than there are indices.
+// Each thread is given its own copy of 'worker'. Returns false if a
+// worker threw.
+template <typename T>
+inline bool parallelFor(index_type n, index_type threads, const T& worker)
+{
+  if (threads <= 0)
+    threads = hardwareConcurrency();
+  threads = std::max(1, std::min(threads, n));
+
+  std::vector<Worker*> workers;
+  for (index_type i = 0; i < threads; ++i)
+    workers.push_back(new T(worker));
+
+  bool ok = parallelFor(n, workers);
+
+  for (index_type i = 0; i < threads; ++i)
+    delete workers[i];
+
+  return ok;
+}
+
+// Concatenate the results a loop gathered for each index, in order of
+// index. 'pIndices', when given, receives the index of each result.
+template <typename T>
+inline void concatenate(const std::vector< std::vector<T> >& results,
+                        std::vector<T>* pOutput,
+                        std::vector<index_type>* pIndices = NULL)
+{
+  for (index_type i = 0; i < utils::size(results); ++i)
+  {
+    pOutput->insert(pOutput->end(), results[i].begin(), results[i].end());
+    if (pIndices != NULL)
+      pIndices->resize(pOutput->size(), i);
+  }
+}
+
+} // namespace thread
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_THREAD_THREAD_POOL_H */
@@ -0,0 +1,108 @@
+#ifndef SOURCETOOLS_THREAD_POSIX_THREAD_H
+#define SOURCETOOLS_THREAD_POSIX_THREAD_H
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <cstddef>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/thread/Runnable.h>
+
+namespace sourcetools {
+namespace detail {
+
+class Mutex : noncopyable
+{
+public:
+
+  Mutex()
+  {
+    ::pthread_mutex_init(&mutex_, NULL);
+  }
+
+  ~Mutex()
+  {
+    ::pthread_mutex_destroy(&mutex_);
+  }
+
+  void lock()
+  {
+    ::pthread_mutex_lock(&mutex_);
+  }
+
+  void unlock()
+  {
+    ::pthread_mutex_unlock(&mutex_);
+  }
+
+private:
+  pthread_mutex_t mutex_;
+};
+
+class Thread : noncopyable
+{
+public:
+
+  explicit Thread(Runnable* pRunnable)
+    : pRunnable_(pRunnable), started_(false)
+  {
+  }
+
+  ~Thread()
+  {
+    join();
+  }
+
+  bool start(std::size_t stackSize)
+  {
+    pthread_attr_t attributes;
+    if (::pthread_attr_init(&attributes) != 0)
+      return false;
+    ::pthread_attr_setstacksize(&attributes, stackSize);
+
+    // Signals (e.g. interrupts) should be handled by the R thread, so
+    // block them all in the new thread; it inherits our signal mask.
+    sigset_t all, previous;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_SETMASK, &all, &previous);
+    started_ = ::pthread_create(&thread_, &attributes, &Thread::main, pRunnable_) == 0;
+    ::pthread_sigmask(SIG_SETMASK, &previous, NULL);
+
+    ::pthread_attr_destroy(&attributes);
+    return started_;
+  }
+
+  void join()
+  {
+    if (!started_)
+      return;
+
+    ::pthread_join(thread_, NULL);
+    started_ = false;
+  }
+
+  static index_type hardwareConcurrency()
+  {
+    long n = ::sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? static_cast<index_type>(n) : 1;
+  }
+
+private:
+
+  static void* main(void* pData)
+  {
+    static_cast<Runnable*>(pData)->run();
+    return NULL;
+  }
+
+  Runnable* pRunnable_;
+  pthread_t thread_;
+  bool started_;
+};
+
+} // namespace detail
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_THREAD_POSIX_THREAD_H */
@@ -0,0 +1,6 @@
+#ifndef SOURCETOOLS_THREAD_THREAD_H
+#define SOURCETOOLS_THREAD_THREAD_H
+
+#include <sourcetools/thread/ThreadPool.h>
+
+#endif /* SOURCETOOLS_THREAD_THREAD_H */
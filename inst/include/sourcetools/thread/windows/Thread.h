@@ -0,0 +1,106 @@
+#ifndef SOURCETOOLS_THREAD_WINDOWS_THREAD_H
+#define SOURCETOOLS_THREAD_WINDOWS_THREAD_H
+
+#undef Realloc
+#undef Free
+
+#include <windows.h>
+
+#include <cstddef>
+
+#include <sourcetools/core/core.h>
+#include <sourcetools/thread/Runnable.h>
+
+namespace sourcetools {
+namespace detail {
+
+class Mutex : noncopyable
+{
+public:
+
+  Mutex()
+  {
+    ::InitializeCriticalSection(&section_);
+  }
+
+  ~Mutex()
+  {
+    ::DeleteCriticalSection(&section_);
+  }
+
+  void lock()
+  {
+    ::EnterCriticalSection(&section_);
+  }
+
+  void unlock()
+  {
+    ::LeaveCriticalSection(&section_);
+  }
+
+private:
+  CRITICAL_SECTION section_;
+};
+
+class Thread : noncopyable
+{
+public:
+
+  explicit Thread(Runnable* pRunnable)
+    : pRunnable_(pRunnable), handle_(NULL)
+  {
+  }
+
+  ~Thread()
+  {
+    join();
+  }
+
+  bool start(std::size_t stackSize)
+  {
+    handle_ = ::CreateThread(
+      NULL,
+      stackSize,
+      &Thread::main,
+      pRunnable_,
+      STACK_SIZE_PARAM_IS_A_RESERVATION,
+      NULL);
+
+    return handle_ != NULL;
+  }
+
+  void join()
+  {
+    if (handle_ == NULL)
+      return;
+
+    ::WaitForSingleObject(handle_, INFINITE);
+    ::CloseHandle(handle_);
+    handle_ = NULL;
+  }
+
+  static index_type hardwareConcurrency()
+  {
+    SYSTEM_INFO info;
+    ::GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ?
+      static_cast<index_type>(info.dwNumberOfProcessors) :
+      1;
+  }
+
+private:
+
+  static DWORD WINAPI main(LPVOID pData)
+  {
+    static_cast<Runnable*>(pData)->run();
+    return 0;
+  }
+
+  Runnable* pRunnable_;
+  HANDLE handle_;
+};
+
+} // namespace detail
+} // namespace sourcetools
+
+#endif /* SOURCETOOLS_THREAD_WINDOWS_THREAD_H */
@@ -60,6 +60,21 @@ public:
   {
   }
 
+  // A token spanning 'length' bytes at 'offset' within 'code', e.g. when
+  // reading back a serialized token stream.
+  Token(const char* code,
+        index_type offset,
+        index_type length,
+        const Position& position,
+        TokenType type)
+    : begin_(code + offset),
+      end_(code + offset + length),
+      offset_(offset),
+      position_(position),
+      type_(type)
+  {
+  }
+
   const char* begin() const { return begin_; }
   const char* end() const { return end_; }
   index_type offset() const { return offset_; }
@@ -385,13 +400,18 @@ inline bool parseUnicode(const char*& it, char*& output)
 
 inline std::string stringValue(const char* begin, const char* end)
 {
-  if (begin == end)
+  if (begin >= end)
     return std::string();
 
+  // Escapes are parsed from a null-terminated copy, so that one cut short
+  // by the end of the range (as in a token read from serialized data,
+  // which need not end where the tokenizer would) is not read past it.
   index_type n = end - begin;
+  std::string input(begin, end);
   scoped_array<char> buffer(new char[n + 1]);
 
-  const char* it = begin;
+  const char* it = input.c_str();
+  end = it + n;
   char* output = buffer;
 
   while (it < end)
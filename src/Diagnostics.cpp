@@ -0,0 +1,353 @@
+#include <sourcetools.h>
+#include <sourcetools/thread/thread.h>
+
+#define R_NO_REMAP
+#include <R.h>
+#include <Rinternals.h>
+
+namespace sourcetools {
+namespace {
+
+using diagnostics::Diagnostic;
+using diagnostics::DiagnosticsSession;
+using diagnostics::DiagnosticsSet;
+using diagnostics::SymbolIndex;
+
+// Reads, parses and diagnoses files on a worker thread. Nothing here
+// may call into R: the objects on the search path are collected on the
+// main thread before the workers start. Each copy of a worker creates
+// its own set of checkers, when first used.
+class DiagnoseWorker : public thread::Worker
+{
+public:
+
+  DiagnoseWorker(const std::vector<std::string>& paths,
+                 const r::SearchPathObjects& objects,
+                 const SymbolIndex* pIndex,
+                 std::vector< std::vector<Diagnostic> >* pResults)
+    : paths_(paths),
+      objects_(objects),
+      pIndex_(pIndex),
+      pSet_(NULL),
+      pResults_(pResults)
+  {
+  }
+
+  DiagnoseWorker(const DiagnoseWorker& other)
+    : paths_(other.paths_),
+      objects_(other.objects_),
+      pIndex_(other.pIndex_),
+      pSet_(NULL),
+      pResults_(other.pResults_)
+  {
+  }
+
+  void operator()(index_type i)
+  {
+    std::vector<Diagnostic>& results = (*pResults_)[i];
+
+    std::string contents;
+    if (!sourcetools::read(paths_[i], &contents))
+    {
+      collections::Position start(0, 0);
+      results.push_back(Diagnostic(
+        diagnostics::DIAGNOSTIC_ERROR,
+        "failed to read file",
+        collections::Range(start, start)));
+      return;
+    }
+
+    parser::Parser parser(contents);
+    parser::ParseStatus status;
+    scoped_ptr<parser::ParseNode> pNode(parser.parse(&status));
+
+    if (pSet_ == NULL)
+      pSet_.reset(diagnostics::createDefaultDiagnosticsSet(objects_, pIndex_));
+
+    pSet_->clear();
+    results = pSet_->run(pNode);
+  }
+
+private:
+  const std::vector<std::string>& paths_;
+  const r::SearchPathObjects& objects_;
+  const SymbolIndex* pIndex_;
+  scoped_ptr<DiagnosticsSet> pSet_;
+  std::vector< std::vector<Diagnostic> >* pResults_;
+};
+
+// Cached diagnostics are stored as columns of their types and positions,
+// with the messages as strings.
+void store(const std::vector<Diagnostic>& diagnostics, cache::Entry* pEntry)
+{
+  std::vector< std::vector<int> >& columns = pEntry->columns;
+  columns.resize(5);
+  for (index_type i = 0; i < utils::size(diagnostics); ++i)
+  {
+    const Diagnostic& diagnostic = diagnostics[i];
+    columns[0].push_back(diagnostic.type());
+    columns[1].push_back(diagnostic.start().row);
+    columns[2].push_back(diagnostic.start().column);
+    columns[3].push_back(diagnostic.end().row);
+    columns[4].push_back(diagnostic.end().column);
+    pEntry->strings.push_back(diagnostic.message());
+  }
+}
+
+bool load(const cache::Entry& entry, std::vector<Diagnostic>* pDiagnostics)
+{
+  const std::vector< std::vector<int> >& columns = entry.columns;
+  if (columns.size() != 5)
+    return false;
+
+  index_type n = utils::size(entry.strings);
+  for (index_type i = 0; i < 5; ++i)
+    if (utils::size(columns[i]) != n)
+      return false;
+
+  for (index_type i = 0; i < n; ++i)
+    if (columns[0][i] < diagnostics::DIAGNOSTIC_ERROR || columns[0][i] > diagnostics::DIAGNOSTIC_STYLE)
+      return false;
+
+  pDiagnostics->clear();
+  for (index_type i = 0; i < n; ++i)
+  {
+    collections::Position start(columns[1][i], columns[2][i]);
+    collections::Position end(columns[3][i], columns[4][i]);
+    pDiagnostics->push_back(Diagnostic(
+      static_cast<diagnostics::DiagnosticType>(columns[0][i]),
+      entry.strings[i],
+      collections::Range(start, end)));
+  }
+
+  return true;
+}
+
+// Diagnose a file, reusing the results of an earlier run when the file,
+// the objects on the search path and the index are all unchanged.
+bool diagnose(const std::string& path,
+              r::SearchPathObjects& objects,
+              const SymbolIndex* pIndex,
+              cache::DiskCache* pCache,
+              std::vector<Diagnostic>* pDiagnostics)
+{
+  hash_type key = 0;
+  bool cached = false;
+  if (pCache != NULL)
+  {
+    hash_type contentHash;
+    if (pCache->hashFile(path, &contentHash))
+    {
+      hash_type inputs = hash::update(contentHash, objects.fingerprint());
+      inputs = hash::update(inputs, pIndex == NULL ? 0 : pIndex->fingerprint());
+      key = pCache->key("diagnostics", inputs);
+      cached = true;
+
+      cache::Entry entry;
+      if (pCache->read(key, &entry) && load(entry, pDiagnostics))
+        return true;
+    }
+  }
+
+  std::string contents;
+  if (!sourcetools::read(path, &contents))
+    return false;
+
+  parser::Parser parser(contents);
+  parser::ParseStatus status;
+  scoped_ptr<parser::ParseNode> pNode(parser.parse(&status));
+
+  scoped_ptr<DiagnosticsSet> pSet(diagnostics::createDefaultDiagnosticsSet(objects, pIndex));
+  *pDiagnostics = pSet->run(pNode);
+
+  if (cached)
+  {
+    cache::Entry entry;
+    store(*pDiagnostics, &entry);
+    pCache->write(key, entry);
+  }
+
+  return true;
+}
+
+// A checker that does no work beyond counting the nodes it is applied
+// to, for measuring the cost of dispatching nodes to checkers. When
+// untyped, it is applied to every node and has to filter them itself.
+class CountingChecker : public diagnostics::checkers::CheckerBase
+{
+public:
+
+  CountingChecker(tokens::TokenType type, bool typed, double* pCount)
+    : type_(type), typed_(typed), pCount_(pCount)
+  {
+  }
+
+  void tokenTypes(std::vector<tokens::TokenType>* pTypes) const
+  {
+    if (typed_)
+      pTypes->push_back(type_);
+  }
+
+  void apply(const parser::ParseNode* pNode,
+             diagnostics::Diagnostics* pDiagnostics,
+             index_type depth)
+  {
+    if (pNode->token().isType(type_))
+      ++*pCount_;
+  }
+
+private:
+  tokens::TokenType type_;
+  bool typed_;
+  double* pCount_;
+};
+
+} // anonymous namespace
+} // namespace sourcetools
+
+extern "C" SEXP sourcetools_diagnose_file(SEXP pathSEXP,
+                                          SEXP indexSEXP,
+                                          SEXP cacheSEXP)
+{
+  using namespace sourcetools;
+
+  const SymbolIndex* pIndex = r::externalPointerAddress<SymbolIndex>(indexSEXP);
+
+  r::SearchPathObjects& objects = r::searchPathObjects();
+  objects.update();
+
+  SEXP resultSEXP = R_NilValue;
+  {
+    scoped_ptr<cache::DiskCache> pCache(r::createDiskCache(cacheSEXP));
+    std::vector<Diagnostic> diagnostics;
+    if (diagnose(CHAR(STRING_ELT(pathSEXP, 0)), objects, pIndex, pCache, &diagnostics))
+      resultSEXP = r::create(diagnostics);
+  }
+
+  if (resultSEXP == R_NilValue)
+    Rf_error("failed to read file '%s'", CHAR(STRING_ELT(pathSEXP, 0)));
+
+  return resultSEXP;
+}
+
+extern "C" SEXP sourcetools_diagnose_files(SEXP pathsSEXP,
+                                           SEXP threadsSEXP,
+                                           SEXP indexSEXP)
+{
+  using namespace sourcetools;
+
+  const SymbolIndex* pIndex = r::externalPointerAddress<SymbolIndex>(indexSEXP);
+
+  r::SearchPathObjects& objects = r::searchPathObjects();
+  objects.update();
+
+  SEXP resultSEXP = R_NilValue;
+  {
+    index_type n = Rf_length(pathsSEXP);
+    std::vector<std::string> paths;
+    for (index_type i = 0; i < n; ++i)
+      paths.push_back(CHAR(STRING_ELT(pathsSEXP, i)));
+
+    std::vector< std::vector<Diagnostic> > results(n);
+    DiagnoseWorker worker(paths, objects, pIndex, &results);
+    if (thread::parallelFor(n, INTEGER(threadsSEXP)[0], worker))
+    {
+      // Merge the results in the order the files were given.
+      std::vector<Diagnostic> diagnostics;
+      std::vector<index_type> files;
+      thread::concatenate(results, &diagnostics, &files);
+      resultSEXP = r::createDataFrame(diagnostics, files);
+    }
+  }
+
+  if (resultSEXP == R_NilValue)
+    Rf_error("failed to diagnose files");
+
+  return resultSEXP;
+}
+
+extern "C" SEXP sourcetools_symbol_index(SEXP pathsSEXP, SEXP namesSEXP)
+{
+  using namespace sourcetools;
+
+  scoped_ptr<SymbolIndex> pIndex(new SymbolIndex);
+
+  for (index_type i = 0; i < Rf_length(namesSEXP); ++i)
+    pIndex->add(CHAR(STRING_ELT(namesSEXP, i)));
+
+  for (index_type i = 0; i < Rf_length(pathsSEXP); ++i)
+  {
+    std::string contents;
+    if (!sourcetools::read(CHAR(STRING_ELT(pathsSEXP, i)), &contents))
+      continue;
+
+    parser::Parser parser(contents);
+    parser::ParseStatus status;
+    scoped_ptr<parser::ParseNode> pNode(parser.parse(&status));
+    pIndex->addDefinitions(pNode);
+  }
+
+  pIndex->finalize();
+
+  return r::createExternalPointer(pIndex.release());
+}
+
+extern "C" SEXP sourcetools_diagnose_session()
+{
+  using namespace sourcetools;
+  return r::createExternalPointer(new DiagnosticsSession);
+}
+
+extern "C" SEXP sourcetools_diagnose_session_update(SEXP sessionSEXP, SEXP strSEXP)
+{
+  using namespace sourcetools;
+
+  DiagnosticsSession* pSession = r::externalPointerAddress<DiagnosticsSession>(sessionSEXP);
+  if (pSession == NULL)
+    Rf_error("invalid diagnostics session");
+
+  r::SearchPathObjects& objects = r::searchPathObjects();
+  objects.update();
+
+  SEXP charSEXP = STRING_ELT(strSEXP, 0);
+  std::string code(CHAR(charSEXP), Rf_length(charSEXP));
+  return r::create(pSession->run(code, objects));
+}
+
+// Run a set of 'checkers' synthetic checkers over a parse tree 'times'
+// times, returning the number of nodes they matched. Only used by the
+// benchmarks, to compare dispatch with and without declared token types.
+extern "C" SEXP sourcetools_benchmark_dispatch(SEXP stringSEXP,
+                                               SEXP checkersSEXP,
+                                               SEXP typedSEXP,
+                                               SEXP timesSEXP)
+{
+  using namespace sourcetools;
+  using namespace sourcetools::tokens;
+
+  static const TokenType types[] = {
+    SYMBOL, NUMBER, STRING, OPERATOR_ASSIGN_LEFT, OPERATOR_PLUS,
+    OPERATOR_EQUAL, LPAREN, LBRACE, KEYWORD_IF, KEYWORD_FUNCTION
+  };
+
+  double count = 0;
+  {
+    SEXP charSEXP = STRING_ELT(stringSEXP, 0);
+    parser::Parser parser(CHAR(charSEXP), Rf_length(charSEXP));
+    parser::ParseStatus status;
+    scoped_ptr<parser::ParseNode> pRoot(parser.parse(&status));
+
+    DiagnosticsSet set;
+    bool typed = Rf_asLogical(typedSEXP) == TRUE;
+    for (int i = 0; i < Rf_asInteger(checkersSEXP); ++i)
+    {
+      TokenType type = types[i % (sizeof(types) / sizeof(types[0]))];
+      set.add(new CountingChecker(type, typed, &count));
+    }
+
+    for (int i = 0; i < Rf_asInteger(timesSEXP); ++i)
+      set.run(pRoot);
+  }
+
+  return Rf_ScalarReal(count);
+}
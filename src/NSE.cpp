@@ -1,27 +1,171 @@
 #include <sourcetools.h>
+#include <sourcetools/thread/thread.h>
 using namespace sourcetools;
 using namespace sourcetools::r;
 
+namespace {
+
+using diagnostics::NseFunction;
+
+// Results are kept for the lifetime of the session. Only ever used from
+// the main thread, as the analysis calls into R.
+nse::Database& database()
+{
+  static nse::Database instance;
+  return instance;
+}
+
+// Reads and parses files on a worker thread, and finds the functions
+// they define. Nothing here may call into R.
+class FindNseWorker : public thread::Worker
+{
+public:
+
+  FindNseWorker(const std::vector<std::string>& paths,
+                std::vector< std::vector<NseFunction> >* pResults)
+    : paths_(paths), pResults_(pResults)
+  {
+  }
+
+  void operator()(index_type i)
+  {
+    std::string contents;
+    if (!sourcetools::read(paths_[i], &contents))
+      return;
+
+    parser::Parser parser(contents);
+    parser::ParseStatus status;
+    scoped_ptr<parser::ParseNode> pNode(parser.parse(&status));
+    diagnostics::findNseFunctions(pNode, i, &(*pResults_)[i]);
+  }
+
+private:
+  const std::vector<std::string>& paths_;
+  std::vector< std::vector<NseFunction> >* pResults_;
+};
+
+SEXP createDataFrame(const std::vector<NseFunction>& functions)
+{
+  index_type n = functions.size();
+
+  RObjectFactory factory;
+  SEXP resultSEXP = factory.create(VECSXP, 5);
+  SEXP fileSEXP   = factory.create(INTSXP, n);
+  SEXP nameSEXP   = factory.create(STRSXP, n);
+  SEXP lineSEXP   = factory.create(INTSXP, n);
+  SEXP columnSEXP = factory.create(INTSXP, n);
+  SEXP nseSEXP    = factory.create(LGLSXP, n);
+
+  for (index_type i = 0; i < n; ++i)
+  {
+    const NseFunction& function = functions[i];
+    INTEGER(fileSEXP)[i]   = function.file + 1;
+    SET_STRING_ELT(nameSEXP, i, createChar(function.name));
+    INTEGER(lineSEXP)[i]   = function.position.row + 1;
+    INTEGER(columnSEXP)[i] = function.position.column + 1;
+    LOGICAL(nseSEXP)[i]    = function.status;
+  }
+
+  SET_VECTOR_ELT(resultSEXP, 0, fileSEXP);
+  SET_VECTOR_ELT(resultSEXP, 1, nameSEXP);
+  SET_VECTOR_ELT(resultSEXP, 2, lineSEXP);
+  SET_VECTOR_ELT(resultSEXP, 3, columnSEXP);
+  SET_VECTOR_ELT(resultSEXP, 4, nseSEXP);
+
+  const char* names[] = {"file", "name", "line", "column", "nse"};
+  util::setNames(resultSEXP, names, 5);
+  util::listToDataFrame(resultSEXP, n);
+
+  return resultSEXP;
+}
+
+} // anonymous namespace
+
 extern "C" SEXP sourcetools_performs_nse(SEXP fnSEXP)
 {
   if (TYPEOF(fnSEXP) == VECSXP || TYPEOF(fnSEXP) == EXPRSXP)
   {
-    Protect protect;
+    // Analyze the functions together, so that the functions they share
+    // are only walked once.
     index_type n = Rf_length(fnSEXP);
-    SEXP resultSEXP = protect(Rf_allocVector(LGLSXP, n));
+    std::vector<SEXP> fns;
     for (index_type i = 0; i < n; ++i)
     {
       SEXP elSEXP = VECTOR_ELT(fnSEXP, i);
-      LOGICAL(resultSEXP)[i] = Rf_isFunction(elSEXP)
-        ? nse::performsNonStandardEvaluation(elSEXP)
-        : 0;
+      if (Rf_isFunction(elSEXP))
+        fns.push_back(elSEXP);
+    }
+
+    std::vector<bool> results;
+    nse::performsNonStandardEvaluation(fns, &database(), &results);
+
+    Protect protect;
+    SEXP resultSEXP = protect(Rf_allocVector(LGLSXP, n));
+    for (index_type i = 0, j = 0; i < n; ++i)
+    {
+      SEXP elSEXP = VECTOR_ELT(fnSEXP, i);
+      LOGICAL(resultSEXP)[i] = Rf_isFunction(elSEXP) ? results[j++] : 0;
     }
     return resultSEXP;
   }
 
   bool result = Rf_isFunction(fnSEXP)
-    ? nse::performsNonStandardEvaluation(fnSEXP)
+    ? nse::performsNonStandardEvaluation(fnSEXP, &database())
     : false;
 
   return Rf_ScalarLogical(result);
 }
+
+extern "C" SEXP sourcetools_nse_cache_stats()
+{
+  const nse::Database& db = database();
+  const nse::Database::Statistics& statistics = db.statistics();
+
+  r::ListBuilder builder;
+  builder.add("size",      Rf_ScalarInteger(db.size()));
+  builder.add("capacity",  Rf_ScalarInteger(db.capacity()));
+  builder.add("hits",      Rf_ScalarReal(statistics.hits));
+  builder.add("misses",    Rf_ScalarReal(statistics.misses));
+  builder.add("evictions", Rf_ScalarReal(statistics.evictions));
+  return builder;
+}
+
+// Capacities beyond 'Database::maxCapacity()' are clamped to it.
+extern "C" SEXP sourcetools_nse_cache_reset(SEXP capacitySEXP)
+{
+  int capacity = Rf_asInteger(capacitySEXP);
+  if (capacity == NA_INTEGER || capacity < 0)
+    Rf_error("invalid cache capacity; expected a non-negative integer");
+
+  database().reset(capacity);
+  return R_NilValue;
+}
+
+extern "C" SEXP sourcetools_find_nse_files(SEXP pathsSEXP, SEXP threadsSEXP)
+{
+  SEXP resultSEXP = R_NilValue;
+  {
+    index_type n = Rf_length(pathsSEXP);
+    std::vector<std::string> paths;
+    for (index_type i = 0; i < n; ++i)
+      paths.push_back(CHAR(STRING_ELT(pathsSEXP, i)));
+
+    std::vector< std::vector<NseFunction> > results(n);
+    FindNseWorker worker(paths, &results);
+    if (thread::parallelFor(n, INTEGER(threadsSEXP)[0], worker))
+    {
+      // Functions may forward '...' to functions defined in other files,
+      // so results are only propagated once every file is analyzed.
+      std::vector<NseFunction> functions;
+      thread::concatenate(results, &functions);
+      diagnostics::propagateNse(&functions);
+
+      resultSEXP = createDataFrame(functions);
+    }
+  }
+
+  if (resultSEXP == R_NilValue)
+    Rf_error("failed to analyze files");
+
+  return resultSEXP;
+}
@@ -8,32 +8,193 @@ namespace sourcetools {
 
 void log(parser::ParseNode* pNode, int depth)
 {
-  if (!pNode)
-    return;
-
-  for (int i = 0; i < depth; ++i)
-    Rprintf("  ");
+  using parser::ParseNode;
 
-  Rprintf("%s\n", toString(pNode->token()).c_str());
+  std::vector<std::pair<const ParseNode*, int> > stack;
+  if (pNode)
+    stack.push_back(std::make_pair(pNode, depth));
 
-  using parser::ParseNode;
-  const std::vector<ParseNode*>& children = pNode->children();
-  for (std::vector<ParseNode*>::const_iterator it = children.begin();
-       it != children.end();
-       ++it)
+  while (!stack.empty())
   {
-    log(*it, depth + 1);
+    const ParseNode* pCurrent = stack.back().first;
+    int level = stack.back().second;
+    stack.pop_back();
+
+    for (int i = 0; i < level; ++i)
+      Rprintf("  ");
+
+    Rprintf("%s\n", toString(pCurrent->token()).c_str());
+
+    const std::vector<ParseNode*>& children = pCurrent->children();
+    for (std::vector<ParseNode*>::const_reverse_iterator it = children.rbegin();
+         it != children.rend();
+         ++it)
+    {
+      stack.push_back(std::make_pair(*it, level + 1));
+    }
   }
 }
 
 namespace {
 
+// Creates 'srcref' objects for parse nodes, equivalent to those R
+// attaches when parsing with 'keep.source = TRUE'. All srcrefs share
+// a single 'srcfile' environment, created on the R side.
+class SrcrefFactory : noncopyable
+{
+public:
+  typedef parser::ParseNode ParseNode;
+  typedef tokens::Token Token;
+
+  SrcrefFactory(const char* code, index_type n, SEXP srcfileSEXP)
+    : n_(n), srcfileSEXP_(srcfileSEXP)
+  {
+    // Columns are counted as R does: by character, with tab stops every
+    // 8 columns. Srcrefs are not requested in order, so the column of
+    // each byte is computed once, up front.
+    lineStarts_.push_back(0);
+    columns_.resize(n);
+    int column = 0;
+    for (index_type i = 0; i < n; ++i)
+    {
+      unsigned char ch = code[i];
+      if ((ch & 0xC0) != 0x80)
+        ++column;
+      if (ch == '\t')
+        column = (column + 7) & ~7;
+      columns_[i] = column;
+
+      if (ch == '\n')
+      {
+        lineStarts_.push_back(i + 1);
+        column = 0;
+      }
+    }
+
+    classSEXP_ = protect_(Rf_mkString("srcref"));
+  }
+
+  SEXP srcfile() const { return srcfileSEXP_; }
+
+  SEXP create(const ParseNode* pNode) const
+  {
+    return create(pNode->begin(), pNode->end());
+  }
+
+  SEXP create(const Token& begin, const Token& end) const
+  {
+    Location first = locate(begin.offset());
+    Location last = locate(end.offset() + end.size() - 1);
+    return create(first, last);
+  }
+
+  // A srcref spanning from the start of the file to the end of 'end',
+  // or to the end of the file if 'end' has no location.
+  SEXP whole(const Token& end) const
+  {
+    Location first = { 1, 0, 0 };
+    Location last = end.offset() == -1
+      ? locate(n_)
+      : locate(end.offset() + end.size() - 1);
+    return create(first, last);
+  }
+
+  // Attach 'srcref', 'srcfile' and 'wholeSrcref' attributes, as R does
+  // for the top-level expression vector and for '{' calls.
+  void attach(SEXP objectSEXP, SEXP srcrefsSEXP, const Token& end) const
+  {
+    static SEXP srcfileSymbol = Rf_install("srcfile");
+    static SEXP wholeSrcrefSymbol = Rf_install("wholeSrcref");
+
+    r::Protect protect;
+    Rf_setAttrib(objectSEXP, R_SrcrefSymbol, srcrefsSEXP);
+    Rf_setAttrib(objectSEXP, srcfileSymbol, srcfileSEXP_);
+    Rf_setAttrib(objectSEXP, wholeSrcrefSymbol, protect(whole(end)));
+  }
+
+private:
+
+  struct Location
+  {
+    int line;
+    int byte;
+    int column;
+  };
+
+  // Locate the byte at 'offset' (or the end of input, when 'offset' is
+  // 'n_').
+  Location locate(index_type offset) const
+  {
+    // Keep within the source, even for nodes without a location.
+    offset = std::max(0, std::min(offset, n_));
+
+    index_type line = std::upper_bound(
+      lineStarts_.begin(), lineStarts_.end(), offset) - lineStarts_.begin() - 1;
+    index_type start = lineStarts_[line];
+
+    int column = 0;
+    if (offset < n_)
+      column = columns_[offset];
+    else if (start < n_)
+      column = columns_[n_ - 1];
+
+    Location location = { line + 1, offset - start + 1, column };
+    if (offset == n_)
+      --location.byte;
+    return location;
+  }
+
+  SEXP create(const Location& first, const Location& last) const
+  {
+    r::Protect protect;
+    SEXP srcrefSEXP = protect(Rf_allocVector(INTSXP, 8));
+    int* srcref = INTEGER(srcrefSEXP);
+    srcref[0] = first.line;
+    srcref[1] = first.byte;
+    srcref[2] = last.line;
+    srcref[3] = last.byte;
+    srcref[4] = first.column;
+    srcref[5] = last.column;
+    srcref[6] = first.line;
+    srcref[7] = last.line;
+
+    static SEXP srcfileSymbol = Rf_install("srcfile");
+    Rf_setAttrib(srcrefSEXP, srcfileSymbol, srcfileSEXP_);
+    Rf_setAttrib(srcrefSEXP, R_ClassSymbol, classSEXP_);
+    return srcrefSEXP;
+  }
+
+  index_type n_;
+  std::vector<index_type> lineStarts_;
+  std::vector<int> columns_;
+
+  r::Protect protect_;
+  SEXP srcfileSEXP_;
+  SEXP classSEXP_;
+};
+
 class SEXPConverter
 {
 private:
   typedef parser::ParseNode ParseNode;
 
-  static SEXP asKeywordSEXP(const tokens::Token& token)
+  // Optional; when set, source references are attached during
+  // conversion.
+  const SrcrefFactory* pSrcrefs_;
+
+  // A node being converted. Its operands (the nodes whose values it is
+  // built from; see 'operands()') are held in 'operands_[begin, end)',
+  // and their values are pushed to the value stack from 'base'.
+  struct Frame
+  {
+    const ParseNode* pNode;
+    index_type begin;
+    index_type end;
+    index_type next;
+    index_type base;
+  };
+
+  SEXP asKeywordSEXP(const tokens::Token& token) const
   {
     using namespace tokens;
 
@@ -49,67 +210,155 @@ private:
     case KEYWORD_NA_real_:      return Rf_ScalarReal(NA_REAL);
     case KEYWORD_NaN:           return Rf_ScalarReal(R_NaN);
     case KEYWORD_NULL:          return R_NilValue;
-    default:                    return Rf_install(token.contents().c_str());
+    default:                    return asSymbolSEXP(token);
     }
   }
 
-  static SEXP asFunctionCallSEXP(const ParseNode* pNode)
+  // Collect the nodes whose values are needed to build 'pNode', in the
+  // order they are consumed by 'build()'.
+  static void operands(const ParseNode* pNode,
+                       std::vector<const ParseNode*>* pOperands)
   {
     using namespace tokens;
 
-    const Token& token = pNode->token();
+    const std::vector<ParseNode*>& children = pNode->children();
+    if (pNode->token().isType(ROOT))
+    {
+      pOperands->insert(pOperands->end(), children.begin(), children.end());
+    }
+    else if (isFunctionCall(pNode))
+    {
+      for (std::vector<ParseNode*>::const_iterator it = children.begin();
+           it != children.end();
+           ++it)
+      {
+        const ParseNode* pChild = *it;
+        const Token& token = pChild->token();
+        if (token.isType(EMPTY))
+          break;
+        else if (token.isType(MISSING))
+          continue;
+        else if (isNamedArgument(pChild))
+          pOperands->push_back(pChild->children()[1]);
+        else
+          pOperands->push_back(pChild);
+      }
+    }
+    else if (pNode->token().isType(KEYWORD_FUNCTION))
+    {
+      if (children.size() != 2)
+        return;
 
-    // Figure out the 'head' of this language object.
-    // '[' and '[[' get these tokens as-is, while '('
-    // instead uses the name of the first child.
-    SEXP langSEXP;
-    if (token.isType(LBRACKET))
-      langSEXP = Rf_lang1(Rf_install("["));
-    else if (token.isType(LDBRACKET))
-      langSEXP = Rf_lang1(Rf_install("[["));
+      const std::vector<ParseNode*>& formals = children[0]->children();
+      for (std::vector<ParseNode*>::const_iterator it = formals.begin();
+           it != formals.end();
+           ++it)
+      {
+        if (hasDefaultValue(*it))
+          pOperands->push_back((*it)->children()[1]);
+      }
+
+      pOperands->push_back(children[1]);
+    }
     else
-      langSEXP = Rf_lang1(R_NilValue);
+    {
+      for (std::vector<ParseNode*>::const_iterator it = children.begin();
+           it != children.end();
+           ++it)
+      {
+        if (!(*it)->token().isType(EMPTY))
+          pOperands->push_back(*it);
+      }
+    }
+  }
+
+  SEXP build(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
+  {
+    using namespace tokens;
 
-    // Start appending the child nodes to our list.
+    const Token& token = pNode->token();
+    if (token.isType(ROOT))
+      return asRootSEXP(pNode, valuesSEXP, index);
+    else if (isFunctionCall(pNode))
+      return asFunctionCallSEXP(pNode, valuesSEXP, index);
+    else if (token.isType(KEYWORD_FUNCTION))
+      return asFunctionDeclSEXP(pNode, valuesSEXP, index);
+
+    return asDefaultSEXP(pNode, valuesSEXP, index);
+  }
+
+  SEXP asRootSEXP(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
+  {
+    const std::vector<ParseNode*>& children = pNode->children();
+    index_type n = children.size();
     r::Protect protect;
-    SEXP headSEXP = protect(langSEXP);
-    for (std::vector<ParseNode*>::const_iterator it = pNode->children().begin();
-         it != pNode->children().end();
-         ++it)
+    SEXP exprSEXP = protect(Rf_allocVector(EXPRSXP, n));
+    for (index_type i = 0; i < n; ++i)
+      SET_VECTOR_ELT(exprSEXP, i, VECTOR_ELT(valuesSEXP, index + i));
+
+    if (pSrcrefs_)
     {
-      const ParseNode* node = *it;
-      const Token& token = node->token();
-      if (token.isType(EMPTY))
+      SEXP srcrefsSEXP = protect(Rf_allocVector(VECSXP, n));
+      for (index_type i = 0; i < n; ++i)
+        SET_VECTOR_ELT(srcrefsSEXP, i, pSrcrefs_->create(children[i]));
+      pSrcrefs_->attach(exprSEXP, srcrefsSEXP, tokens::Token(tokens::END));
+    }
+
+    return exprSEXP;
+  }
+
+  SEXP asFunctionCallSEXP(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
+  {
+    using namespace tokens;
+
+    const Token& token = pNode->token();
+    const std::vector<ParseNode*>& children = pNode->children();
+
+    // '[' and '[[' use these tokens as the function, while for '(' the
+    // function is the first child.
+    bool isBracket = token.isType(LBRACKET) || token.isType(LDBRACKET);
+
+    index_type count = 0;
+    for (index_type i = 0, n = children.size(); i < n; ++i, ++count)
+      if (children[i]->token().isType(EMPTY))
         break;
-      else if (token.isType(MISSING))
-        SETCDR(langSEXP, Rf_lang1(R_MissingArg));
 
-      else if (token.isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS))
+    index_type n = count + isBracket;
+    if (n == 0)
+      return R_NilValue;
+
+    r::Protect protect;
+    SEXP resultSEXP = protect(r::allocLang(n));
+    SEXP langSEXP = resultSEXP;
+    if (isBracket)
+    {
+      SETCAR(langSEXP, asSymbolSEXP(token));
+      langSEXP = CDR(langSEXP);
+    }
+
+    for (index_type i = 0; i < count; ++i, langSEXP = CDR(langSEXP))
+    {
+      const ParseNode* node = children[i];
+      const Token& token = node->token();
+      if (token.isType(MISSING))
+      {
+        SETCAR(langSEXP, R_MissingArg);
+      }
+      else if (isNamedArgument(node))
       {
         const ParseNode* lhs = node->children()[0];
         const ParseNode* rhs = node->children()[1];
 
-        if (rhs->token().isType(MISSING))
-          SETCDR(langSEXP, Rf_lang1(R_MissingArg));
-        else
-          SETCDR(langSEXP, Rf_lang1(asSEXP(rhs)));
-
-        const Token& token = lhs->token();
-        SEXP nameSEXP = Rf_install(tokens::stringValue(token).c_str());
-        SET_TAG(CDR(langSEXP), nameSEXP);
+        SEXP valueSEXP = VECTOR_ELT(valuesSEXP, index++);
+        SETCAR(langSEXP, rhs->token().isType(MISSING) ? R_MissingArg : valueSEXP);
+        SET_TAG(langSEXP, asSymbolSEXP(lhs->token()));
       }
       else
       {
-        SETCDR(langSEXP, Rf_lang1(asSEXP(node)));
+        SETCAR(langSEXP, VECTOR_ELT(valuesSEXP, index++));
       }
-
-      langSEXP = CDR(langSEXP);
     }
 
-    SEXP resultSEXP = CAR(headSEXP) == R_NilValue
-      ? CDR(headSEXP)
-      : headSEXP;
-
     // Convert strings to symbols at head position
     if (TYPEOF(CAR(resultSEXP)) == STRSXP)
       SETCAR(resultSEXP, Rf_install(CHAR(STRING_ELT(CAR(resultSEXP), 0))));
@@ -117,7 +366,7 @@ private:
     return resultSEXP;
   }
 
-  static SEXP asFunctionArgumentListSEXP(const ParseNode* pNode)
+  SEXP asFunctionArgumentListSEXP(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
   {
     index_type n = pNode->children().size();
     if (n == 0)
@@ -133,19 +382,18 @@ private:
       const ParseNode* pChild = *it;
       const tokens::Token& token = pChild->token();
 
-      if (tokens::isOperator(token))
+      if (hasDefaultValue(pChild))
       {
         const ParseNode* pLhs = pChild->children()[0];
-        const ParseNode* pRhs = pChild->children()[1];
 
         if (pLhs->token().isType(tokens::SYMBOL))
-          SET_TAG(headSEXP, Rf_install(tokens::stringValue(pLhs->token()).c_str()));
-        SETCAR(headSEXP, asSEXP(pRhs));
+          SET_TAG(headSEXP, asSymbolSEXP(pLhs->token()));
+        SETCAR(headSEXP, VECTOR_ELT(valuesSEXP, index++));
       }
       else if (token.isType(tokens::SYMBOL))
       {
         SETCAR(headSEXP, R_MissingArg);
-        SET_TAG(headSEXP, Rf_install(tokens::stringValue(token).c_str()));
+        SET_TAG(headSEXP, asSymbolSEXP(token));
       }
 
       headSEXP = CDR(headSEXP);
@@ -154,108 +402,258 @@ private:
     return listSEXP;
   }
 
-  static SEXP asFunctionDeclSEXP(const ParseNode* pNode)
+  SEXP asFunctionDeclSEXP(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
   {
     if (pNode->children().size() != 2)
       return R_NilValue;
 
+    // The body is the last operand, following any default values.
+    const ParseNode* pFormals = pNode->children()[0];
+    index_type body = index;
+    for (index_type i = 0, n = pFormals->children().size(); i < n; ++i)
+      if (hasDefaultValue(pFormals->children()[i]))
+        ++body;
+
     r::Protect protect;
-    SEXP argsSEXP = protect(asFunctionArgumentListSEXP(pNode->children()[0]));
-    SEXP bodySEXP = protect(asSEXP(pNode->children()[1]));
-    SEXP fnSEXP = Rf_install("function");
-    SEXP resultSEXP = Rf_lang4(fnSEXP, argsSEXP, bodySEXP, R_NilValue);
+    SEXP argsSEXP = protect(asFunctionArgumentListSEXP(pFormals, valuesSEXP, index));
+    SEXP bodySEXP = VECTOR_ELT(valuesSEXP, body);
+    SEXP srcrefSEXP = pSrcrefs_
+      ? protect(pSrcrefs_->create(pNode))
+      : R_NilValue;
+    static SEXP functionSymbol = Rf_install("function");
+    SEXP resultSEXP = Rf_lang4(functionSymbol, argsSEXP, bodySEXP, srcrefSEXP);
     return resultSEXP;
   }
 
+  // Tokens read from serialized data are not followed by a null, so the
+  // number is converted from a copy.
   static SEXP asNumericSEXP(const tokens::Token& token)
   {
-    if (*(token.end() - 1) == 'L')
-      return Rf_ScalarInteger(::atof(token.begin()));
+    std::string contents = token.contents();
+    if (!contents.empty() && contents[contents.size() - 1] == 'L')
+      return Rf_ScalarInteger(::atof(contents.c_str()));
     else
-      return Rf_ScalarReal(::atof(token.begin()));
-  }
-
-  static bool isFunctionCall(const ParseNode* pNode)
-  {
-    const tokens::Token& token = pNode->token();
-    if (token.isType(tokens::LBRACKET) || token.isType(tokens::LDBRACKET))
-      return true;
-
-    // Differentiate between '(a)' and 'a()'.
-    if (token.isType(tokens::LPAREN))
-      return pNode->children().size() > 1;
-
-    return false;
+      return Rf_ScalarReal(::atof(contents.c_str()));
   }
 
-public:
-  static SEXP asSEXP(const ParseNode* pNode)
+  SEXP asDefaultSEXP(const ParseNode* pNode, SEXP valuesSEXP, index_type index) const
   {
     using namespace tokens;
 
-    if (!pNode)
-      return R_NilValue;
-
-    if (pNode->token().isType(tokens::ROOT))
-    {
-      const std::vector<ParseNode*>& children = pNode->children();
-      index_type n = pNode->children().size();
-      r::Protect protect;
-      SEXP exprSEXP = protect(Rf_allocVector(EXPRSXP, n));
-      for (index_type i = 0; i < n; ++i)
-        SET_VECTOR_ELT(exprSEXP, i, asSEXP(children[i]));
-      return exprSEXP;
-    }
-
-    // Handle function calls specially
-    if (isFunctionCall(pNode))
-      return asFunctionCallSEXP(pNode);
+    static SEXP exponentiationSymbol = Rf_install("^");
+    static SEXP breakSymbol = Rf_install("break");
+    static SEXP nextSymbol = Rf_install("next");
 
     const tokens::Token& token = pNode->token();
-    if (token.isType(KEYWORD_FUNCTION))
-      return asFunctionDeclSEXP(pNode);
 
     SEXP elSEXP;
     r::Protect protect;
     if (token.isType(MISSING))
       elSEXP = R_MissingArg;
     else if (token.isType(OPERATOR_EXPONENTATION_STARS))
-      elSEXP = Rf_install("^");
+      elSEXP = exponentiationSymbol;
     else if (token.isType(KEYWORD_BREAK))
-      elSEXP = Rf_lang1(Rf_install("break"));
+      elSEXP = Rf_lang1(breakSymbol);
     else if (token.isType(KEYWORD_NEXT))
-      elSEXP = Rf_lang1(Rf_install("next"));
+      elSEXP = Rf_lang1(nextSymbol);
     else if (isKeyword(token))
       elSEXP = asKeywordSEXP(token);
     else if (isOperator(token) || isLeftBracket(token))
-      elSEXP = Rf_install(token.contents().c_str());
+      elSEXP = asSymbolSEXP(token);
     else if (isNumeric(token))
       elSEXP = asNumericSEXP(token);
     else if (isSymbol(token))
-      elSEXP = Rf_install(tokens::stringValue(token).c_str());
+      elSEXP = asSymbolSEXP(token);
     else if (isString(token))
       elSEXP = Rf_mkString(tokens::stringValue(token).c_str());
     else
       elSEXP = Rf_mkString(token.contents().c_str());
 
-    if (pNode->children().empty())
+    const std::vector<ParseNode*>& children = pNode->children();
+    if (children.empty())
       return elSEXP;
 
-    SEXP headSEXP = protect(Rf_lang1(protect(elSEXP)));
-    SEXP listSEXP = headSEXP;
-    for (std::vector<ParseNode*>::const_iterator it = pNode->children().begin();
-         it != pNode->children().end();
-         ++it)
+    index_type n = 1;
+    for (index_type i = 0, size = children.size(); i < size; ++i)
+      if (!children[i]->token().isType(EMPTY))
+        ++n;
+
+    protect(elSEXP);
+    SEXP headSEXP = protect(r::allocLang(n));
+    SETCAR(headSEXP, elSEXP);
+
+    SEXP listSEXP = CDR(headSEXP);
+    for (index_type i = 0, size = children.size(); i < size; ++i)
     {
-      const ParseNode* child = *it;
-      if (!child->token().isType(EMPTY))
-        listSEXP = SETCDR(listSEXP, Rf_lang1(asSEXP(child)));
+      if (children[i]->token().isType(EMPTY))
+        continue;
+
+      SETCAR(listSEXP, VECTOR_ELT(valuesSEXP, index++));
+      listSEXP = CDR(listSEXP);
     }
 
+    if (pSrcrefs_ && token.isType(LBRACE))
+      attachBraceSrcrefs(headSEXP, pNode);
+
     return headSEXP;
   }
 
-  static SEXP asSEXP(const std::vector<ParseNode*>& expression)
+  // R records a srcref for the '{' itself, followed by one for each
+  // expression within the braces.
+  void attachBraceSrcrefs(SEXP braceSEXP, const ParseNode* pNode) const
+  {
+    const std::vector<ParseNode*>& children = pNode->children();
+
+    index_type n = 1;
+    for (index_type i = 0, size = children.size(); i < size; ++i)
+      if (!children[i]->token().isType(tokens::EMPTY))
+        ++n;
+
+    r::Protect protect;
+    SEXP srcrefsSEXP = protect(Rf_allocVector(VECSXP, n));
+    const tokens::Token& token = pNode->token();
+    SET_VECTOR_ELT(srcrefsSEXP, 0, pSrcrefs_->create(token, token));
+
+    index_type index = 1;
+    for (index_type i = 0, size = children.size(); i < size; ++i)
+      if (!children[i]->token().isType(tokens::EMPTY))
+        SET_VECTOR_ELT(srcrefsSEXP, index++, pSrcrefs_->create(children[i]));
+
+    pSrcrefs_->attach(braceSEXP, srcrefsSEXP, pNode->end());
+  }
+
+  // Get the symbol for an operator, keyword or identifier. Symbols are
+  // never garbage collected, so those for operators and keywords (whose
+  // spelling is fixed by their token type) are cached; identifiers are
+  // installed from a reused buffer rather than a fresh string.
+  SEXP asSymbolSEXP(const tokens::Token& token) const
+  {
+    using namespace tokens;
+
+    bool fixed =
+      (isOperator(token) && !token.isType(OPERATOR_USER)) ||
+      isKeyword(token) ||
+      isLeftBracket(token);
+
+    if (!fixed)
+    {
+      if (!isSymbol(token) || *token.begin() == '`')
+        return Rf_install(tokens::stringValue(token).c_str());
+
+      buffer_.assign(token.begin(), token.end());
+      return Rf_install(buffer_.c_str());
+    }
+
+    std::map<TokenType, SEXP>::const_iterator it = symbols_.find(token.type());
+    if (it != symbols_.end())
+      return it->second;
+
+    SEXP symbolSEXP = Rf_install(token.contents().c_str());
+    symbols_[token.type()] = symbolSEXP;
+    return symbolSEXP;
+  }
+
+  // Arguments given as 'name = value', and formals with a default value.
+  // Their children are checked too, as trees with parse errors (or read
+  // from serialized data) may lack some.
+  static bool isNamedArgument(const ParseNode* pNode)
+  {
+    return pNode->token().isType(tokens::OPERATOR_ASSIGN_LEFT_EQUALS) &&
+           pNode->children().size() == 2;
+  }
+
+  static bool hasDefaultValue(const ParseNode* pNode)
+  {
+    return tokens::isOperator(pNode->token()) &&
+           pNode->children().size() == 2;
+  }
+
+  static bool isFunctionCall(const ParseNode* pNode)
+  {
+    const tokens::Token& token = pNode->token();
+    if (token.isType(tokens::LBRACKET) || token.isType(tokens::LDBRACKET))
+      return true;
+
+    // Differentiate between '(a)' and 'a()'.
+    if (token.isType(tokens::LPAREN))
+      return pNode->children().size() > 1;
+
+    return false;
+  }
+
+  void push(const ParseNode* pNode, index_type base) const
+  {
+    Frame frame;
+    frame.pNode = pNode;
+    frame.begin = utils::size(operands_);
+    operands(pNode, &operands_);
+    frame.end = utils::size(operands_);
+    frame.next = frame.begin;
+    frame.base = base;
+    frames_.push_back(frame);
+  }
+
+  mutable std::vector<Frame> frames_;
+  mutable std::vector<const ParseNode*> operands_;
+
+  mutable std::map<tokens::TokenType, SEXP> symbols_;
+  mutable std::string buffer_;
+
+public:
+
+  explicit SEXPConverter(const SrcrefFactory* pSrcrefs = NULL)
+    : pSrcrefs_(pSrcrefs)
+  {
+  }
+
+  // Convert the tree in post-order, with an explicit stack rather than
+  // recursion, so that deeply nested code cannot overflow the C stack.
+  // Converted values wait on a (protected) value stack until their
+  // parent is built.
+  SEXP asSEXP(const ParseNode* pNode) const
+  {
+    if (!pNode)
+      return R_NilValue;
+
+    // Every node contributes at most one value at a time.
+    index_type size = 0;
+    operands_.assign(1, pNode);
+    while (!operands_.empty())
+    {
+      const ParseNode* pCurrent = operands_.back();
+      operands_.pop_back();
+      operands_.insert(operands_.end(),
+                       pCurrent->children().begin(),
+                       pCurrent->children().end());
+      ++size;
+    }
+
+    r::Protect protect;
+    SEXP valuesSEXP = protect(Rf_allocVector(VECSXP, size));
+    index_type count = 0;
+
+    push(pNode, count);
+    while (!frames_.empty())
+    {
+      Frame& frame = frames_.back();
+      if (frame.next != frame.end)
+      {
+        push(operands_[frame.next++], count);
+        continue;
+      }
+
+      SEXP resultSEXP = build(frame.pNode, valuesSEXP, frame.base);
+      count = frame.base;
+      operands_.resize(frame.begin);
+      frames_.pop_back();
+
+      SET_VECTOR_ELT(valuesSEXP, count++, resultSEXP);
+    }
+
+    return VECTOR_ELT(valuesSEXP, 0);
+  }
+
+  SEXP asSEXP(const std::vector<ParseNode*>& expression) const
   {
     index_type n = expression.size();
     r::Protect protect;
@@ -287,10 +685,195 @@ void reportErrors(const std::vector<parser::ParseError>& errors)
   Rf_warning("%s", message.c_str());
 }
 
+// A parse tree kept alive behind an external pointer, so that callers
+// can inspect it (and convert only the parts they need) without first
+// converting the whole tree to R objects.
+//
+// Nodes are identified by their index in a pre-order walk of the tree;
+// the root node has id 0, and so top-level expressions have parent 0.
+class ParseHandle : noncopyable
+{
+public:
+  typedef parser::ParseNode ParseNode;
+
+  ParseHandle(const char* code, index_type n)
+    : pTree_(NULL)
+  {
+    parser::Parser parser(code, n);
+    parser::ParseStatus status;
+    pRoot_ = parser.parse(&status);
+    errors_ = status.getErrors();
+    index();
+  }
+
+  // Adopt a tree read back from its serialized form, along with the
+  // source it refers to.
+  explicit ParseHandle(serialize::ParseTree* pTree)
+    : pTree_(pTree)
+  {
+    pRoot_ = pTree->release();
+    errors_ = pTree->errors();
+    index();
+  }
+
+  ~ParseHandle()
+  {
+    delete pRoot_;
+  }
+
+  index_type size() const { return utils::size(nodes_); }
+  const ParseNode* node(index_type id) const { return nodes_[id]; }
+  index_type parent(index_type id) const { return parents_[id]; }
+
+  std::vector<index_type> children(index_type id) const
+  {
+    std::vector<index_type> children;
+
+    // Children follow their parent in pre-order, each preceded by
+    // the subtrees of their earlier siblings.
+    index_type child = id + 1;
+    index_type n = nodes_[id]->children().size();
+    for (index_type i = 0; i < n; ++i)
+    {
+      children.push_back(child);
+      child += sizes_[child];
+    }
+
+    return children;
+  }
+
+  const std::vector<parser::ParseError>& errors() const
+  {
+    return errors_;
+  }
+
+private:
+
+  void index()
+  {
+    std::vector<std::pair<const ParseNode*, index_type> > stack;
+    stack.push_back(std::make_pair(pRoot_, -1));
+
+    while (!stack.empty())
+    {
+      const ParseNode* pNode = stack.back().first;
+      index_type parent = stack.back().second;
+      stack.pop_back();
+
+      index_type id = size();
+      nodes_.push_back(pNode);
+      parents_.push_back(parent);
+
+      const std::vector<ParseNode*>& children = pNode->children();
+      for (std::vector<ParseNode*>::const_reverse_iterator it = children.rbegin();
+           it != children.rend();
+           ++it)
+      {
+        stack.push_back(std::make_pair(*it, id));
+      }
+    }
+
+    sizes_.assign(nodes_.size(), 1);
+    for (index_type id = size() - 1; id > 0; --id)
+      sizes_[parents_[id]] += sizes_[id];
+  }
+
+  scoped_ptr<serialize::ParseTree> pTree_;
+  ParseNode* pRoot_;
+  std::vector<parser::ParseError> errors_;
+
+  std::vector<const ParseNode*> nodes_;
+  std::vector<index_type> parents_;
+  std::vector<index_type> sizes_;
+};
+
+ParseHandle& parseHandle(SEXP handleSEXP)
+{
+  ParseHandle* pHandle = r::externalPointerAddress<ParseHandle>(handleSEXP);
+  if (pHandle == NULL)
+    Rf_error("invalid parse handle");
+  return *pHandle;
+}
+
+std::vector<index_type> nodeIds(const ParseHandle& handle, SEXP idsSEXP)
+{
+  r::Protect protect;
+  SEXP integerSEXP = protect(Rf_coerceVector(idsSEXP, INTSXP));
+
+  index_type n = Rf_length(integerSEXP);
+  for (index_type i = 0; i < n; ++i)
+  {
+    int id = INTEGER(integerSEXP)[i];
+    if (id == NA_INTEGER || id < 0 || id >= handle.size())
+      Rf_error("invalid node id '%i'", id);
+  }
+
+  return std::vector<index_type>(INTEGER(integerSEXP), INTEGER(integerSEXP) + n);
+}
+
+SEXP createIntegerVector(const std::vector<index_type>& data)
+{
+  index_type n = data.size();
+  SEXP resultSEXP = Rf_allocVector(INTSXP, n);
+  std::copy(data.begin(), data.end(), INTEGER(resultSEXP));
+  return resultSEXP;
+}
+
+class NodeColumnSetter
+{
+public:
+  enum Column { PARENT, TYPE, TEXT, LINE1, COL1, LINE2, COL2 };
+
+  NodeColumnSetter(const ParseHandle& handle, Column column)
+    : handle_(handle), column_(column)
+  {
+  }
+
+  void operator()(SEXP dataSEXP, index_type i, index_type id)
+  {
+    const parser::ParseNode* pNode = handle_.node(id);
+    const tokens::Token& token = pNode->token();
+
+    // Nodes without a source location (e.g. missing arguments).
+    bool located = pNode->begin().offset() != -1;
+
+    switch (column_)
+    {
+    case PARENT:
+      INTEGER(dataSEXP)[i] = handle_.parent(id);
+      break;
+    case TYPE:
+      SET_STRING_ELT(dataSEXP, i, r::createChar(toString(token.type())));
+      break;
+    case TEXT:
+      SET_STRING_ELT(dataSEXP, i, token.offset() == -1
+        ? NA_STRING
+        : Rf_mkCharLenCE(token.begin(), token.size(), CE_UTF8));
+      break;
+    case LINE1:
+      INTEGER(dataSEXP)[i] = located ? pNode->range().start().row + 1 : NA_INTEGER;
+      break;
+    case COL1:
+      INTEGER(dataSEXP)[i] = located ? pNode->range().start().column + 1 : NA_INTEGER;
+      break;
+    case LINE2:
+      INTEGER(dataSEXP)[i] = located ? pNode->range().end().row + 1 : NA_INTEGER;
+      break;
+    case COL2:
+      INTEGER(dataSEXP)[i] = located ? pNode->range().end().column : NA_INTEGER;
+      break;
+    }
+  }
+
+private:
+  const ParseHandle& handle_;
+  Column column_;
+};
+
 } // anonymous namespace
 } // namespace sourcetools
 
-extern "C" SEXP sourcetools_parse_string(SEXP programSEXP)
+extern "C" SEXP sourcetools_parse_string(SEXP programSEXP, SEXP srcfileSEXP)
 {
   using namespace sourcetools;
   using parser::ParseStatus;
@@ -298,17 +881,98 @@ extern "C" SEXP sourcetools_parse_string(SEXP programSEXP)
   using parser::ParseNode;
 
   SEXP charSEXP = STRING_ELT(programSEXP, 0);
-  Parser parser(CHAR(charSEXP), Rf_length(charSEXP));
+  const char* code = CHAR(charSEXP);
+  index_type n = Rf_length(charSEXP);
+  Parser parser(code, n);
 
   ParseStatus status;
   scoped_ptr<ParseNode> pRoot(parser.parse(&status));
 
   sourcetools::reportErrors(status.getErrors());
 
-  return sourcetools::SEXPConverter::asSEXP(pRoot);
+  // Attach source references when given a 'srcfile'.
+  if (Rf_isEnvironment(srcfileSEXP))
+  {
+    SrcrefFactory srcrefs(code, n, srcfileSEXP);
+    return SEXPConverter(&srcrefs).asSEXP(pRoot);
+  }
+
+  return SEXPConverter().asSEXP(pRoot);
+}
+
+// Parse a file, reusing its parse tree from the cache (when enabled) if
+// the file's contents were parsed before. Trees are cached in their
+// serialized form, and memory mapped when read back.
+extern "C" SEXP sourcetools_parse_file(SEXP absolutePathSEXP,
+                                       SEXP srcfileSEXP,
+                                       SEXP cacheSEXP)
+{
+  using namespace sourcetools;
+  using parser::ParseNode;
+
+  const char* absolutePath = CHAR(STRING_ELT(absolutePathSEXP, 0));
+
+  // Everything owned here is released before calling back into R with
+  // an error.
+  SEXP resultSEXP = NULL;
+  {
+    scoped_ptr<cache::DiskCache> pCache(r::createDiskCache(cacheSEXP));
+
+    // The file is read (and hashed) once; its key serves both to look up
+    // the tree, and to store it when it had to be parsed.
+    std::string contents;
+    hash_type contentHash = 0;
+    bool ok = pCache == NULL
+      ? sourcetools::read(absolutePath, &contents)
+      : pCache->hashFile(absolutePath, &contentHash, &contents);
+
+    if (ok)
+    {
+      hash_type key = pCache == NULL ? 0 : pCache->key("parse", contentHash);
+
+      serialize::ParseTree tree;
+      bool cached = pCache != NULL && tree.read(pCache->path(key));
+
+      parser::ParseStatus status;
+      scoped_ptr<ParseNode> pRoot(NULL);
+      if (!cached)
+      {
+        parser::Parser parser(contents);
+        pRoot.reset(parser.parse(&status));
+
+        if (pCache != NULL)
+        {
+          std::string buffer;
+          serialize::write(contents.data(), utils::size(contents), pRoot, status.getErrors(), &buffer);
+          pCache->write(key, buffer);
+        }
+      }
+
+      const char* code = cached ? tree.code() : contents.data();
+      index_type n = cached ? tree.size() : utils::size(contents);
+      const ParseNode* pNode = cached ? tree.root() : static_cast<const ParseNode*>(pRoot);
+
+      sourcetools::reportErrors(cached ? tree.errors() : status.getErrors());
+
+      if (Rf_isEnvironment(srcfileSEXP))
+      {
+        SrcrefFactory srcrefs(code, n, srcfileSEXP);
+        resultSEXP = SEXPConverter(&srcrefs).asSEXP(pNode);
+      }
+      else
+      {
+        resultSEXP = SEXPConverter().asSEXP(pNode);
+      }
+    }
+  }
+
+  if (resultSEXP == NULL)
+    Rf_error("failed to read file '%s'", absolutePath);
+
+  return resultSEXP;
 }
 
-extern "C" SEXP sourcetools_diagnose_string(SEXP strSEXP)
+extern "C" SEXP sourcetools_diagnose_string(SEXP strSEXP, SEXP indexSEXP)
 {
   using namespace sourcetools;
   using parser::Parser;
@@ -323,7 +987,229 @@ extern "C" SEXP sourcetools_diagnose_string(SEXP strSEXP)
   scoped_ptr<ParseNode> pNode(parser.parse(&status));
 
   using namespace diagnostics;
-  scoped_ptr<DiagnosticsSet> pDiagnostics(createDefaultDiagnosticsSet());
+  const SymbolIndex* pIndex = r::externalPointerAddress<SymbolIndex>(indexSEXP);
+  scoped_ptr<DiagnosticsSet> pDiagnostics(createDefaultDiagnosticsSet(pIndex));
   std::vector<Diagnostic> diagnostics = pDiagnostics->run(pNode);
   return r::create(diagnostics);
 }
+
+extern "C" SEXP sourcetools_diagnose_strings(SEXP stringsSEXP, SEXP indexSEXP)
+{
+  using namespace sourcetools;
+  using parser::Parser;
+  using parser::ParseStatus;
+  using parser::ParseNode;
+
+  using namespace diagnostics;
+  std::vector<Diagnostic> diagnostics;
+  std::vector<index_type> files;
+
+  const SymbolIndex* pIndex = r::externalPointerAddress<SymbolIndex>(indexSEXP);
+  index_type n = Rf_length(stringsSEXP);
+  for (index_type i = 0; i < n; ++i)
+  {
+    SEXP charSEXP = STRING_ELT(stringsSEXP, i);
+    Parser parser(CHAR(charSEXP), Rf_length(charSEXP));
+
+    ParseStatus status;
+    scoped_ptr<ParseNode> pNode(parser.parse(&status));
+
+    scoped_ptr<DiagnosticsSet> pDiagnostics(createDefaultDiagnosticsSet(pIndex));
+    const std::vector<Diagnostic>& results = pDiagnostics->run(pNode);
+    diagnostics.insert(diagnostics.end(), results.begin(), results.end());
+    files.resize(diagnostics.size(), i);
+  }
+
+  return r::createDataFrame(diagnostics, files);
+}
+
+extern "C" SEXP sourcetools_parse_handle(SEXP programSEXP)
+{
+  using namespace sourcetools;
+
+  SEXP charSEXP = STRING_ELT(programSEXP, 0);
+
+  // The parse tree refers to the program text, so keep it alive
+  // alongside the handle. The pointer is allocated first, and only then
+  // given the handle, so that the handle cannot leak should allocating
+  // the pointer fail.
+  r::Protect protect;
+  SEXP handleSEXP = protect(r::createExternalPointer<ParseHandle>(NULL, R_NilValue, charSEXP));
+
+  ParseHandle* pHandle = new ParseHandle(CHAR(charSEXP), Rf_length(charSEXP));
+  R_SetExternalPtrAddr(handleSEXP, pHandle);
+
+  sourcetools::reportErrors(pHandle->errors());
+  return handleSEXP;
+}
+
+extern "C" SEXP sourcetools_serialize_parse(SEXP programSEXP)
+{
+  using namespace sourcetools;
+
+  std::string buffer;
+  {
+    SEXP charSEXP = STRING_ELT(programSEXP, 0);
+    const char* code = CHAR(charSEXP);
+    index_type n = Rf_length(charSEXP);
+
+    parser::Parser parser(code, n);
+    parser::ParseStatus status;
+    scoped_ptr<parser::ParseNode> pRoot(parser.parse(&status));
+    serialize::write(code, n, pRoot, status.getErrors(), &buffer);
+  }
+
+  SEXP resultSEXP = Rf_allocVector(RAWSXP, buffer.size());
+  std::copy(buffer.begin(), buffer.end(), reinterpret_cast<char*>(RAW(resultSEXP)));
+  return resultSEXP;
+}
+
+// Read a parse tree serialized as a raw vector, or to the file at a
+// path, into a parse handle. The tree refers to the source within the
+// serialized data, so the raw vector is kept alive (and the file kept
+// mapped) alongside the handle.
+extern "C" SEXP sourcetools_deserialize_parse(SEXP dataSEXP)
+{
+  using namespace sourcetools;
+
+  ParseHandle* pHandle = NULL;
+  {
+    scoped_ptr<serialize::ParseTree> pTree(new serialize::ParseTree);
+
+    bool ok = TYPEOF(dataSEXP) == RAWSXP
+      ? pTree->read(reinterpret_cast<const char*>(RAW(dataSEXP)), Rf_length(dataSEXP))
+      : pTree->read(std::string(CHAR(STRING_ELT(dataSEXP, 0))));
+
+    if (ok)
+      pHandle = new ParseHandle(pTree.release());
+  }
+
+  if (pHandle == NULL)
+    Rf_error("invalid or unsupported serialized parse tree");
+
+  SEXP protectedSEXP = TYPEOF(dataSEXP) == RAWSXP ? dataSEXP : R_NilValue;
+  return r::createExternalPointer(pHandle, R_NilValue, protectedSEXP);
+}
+
+extern "C" SEXP sourcetools_parse_handle_children(SEXP handleSEXP, SEXP idSEXP)
+{
+  using namespace sourcetools;
+
+  if (Rf_length(idSEXP) != 1)
+    Rf_error("expected a single node id");
+
+  const ParseHandle& handle = parseHandle(handleSEXP);
+  std::vector<index_type> ids = nodeIds(handle, idSEXP);
+  return createIntegerVector(handle.children(ids[0]));
+}
+
+extern "C" SEXP sourcetools_parse_handle_nodes(SEXP handleSEXP, SEXP idsSEXP)
+{
+  using namespace sourcetools;
+  typedef NodeColumnSetter Setter;
+
+  const ParseHandle& handle = parseHandle(handleSEXP);
+  std::vector<index_type> ids = nodeIds(handle, idsSEXP);
+
+  r::RObjectFactory factory;
+  SEXP resultSEXP = factory.create(VECSXP, 8);
+  SET_VECTOR_ELT(resultSEXP, 0, createIntegerVector(ids));
+  SET_VECTOR_ELT(resultSEXP, 1, factory.create(INTSXP, ids, Setter(handle, Setter::PARENT)));
+  SET_VECTOR_ELT(resultSEXP, 2, factory.create(STRSXP, ids, Setter(handle, Setter::TYPE)));
+  SET_VECTOR_ELT(resultSEXP, 3, factory.create(STRSXP, ids, Setter(handle, Setter::TEXT)));
+  SET_VECTOR_ELT(resultSEXP, 4, factory.create(INTSXP, ids, Setter(handle, Setter::LINE1)));
+  SET_VECTOR_ELT(resultSEXP, 5, factory.create(INTSXP, ids, Setter(handle, Setter::COL1)));
+  SET_VECTOR_ELT(resultSEXP, 6, factory.create(INTSXP, ids, Setter(handle, Setter::LINE2)));
+  SET_VECTOR_ELT(resultSEXP, 7, factory.create(INTSXP, ids, Setter(handle, Setter::COL2)));
+
+  const char* names[] = {"id", "parent", "type", "text", "line1", "col1", "line2", "col2"};
+  r::util::setNames(resultSEXP, names, 8);
+  r::util::listToDataFrame(resultSEXP, ids.size());
+
+  return resultSEXP;
+}
+
+extern "C" SEXP sourcetools_parse_handle_convert(SEXP handleSEXP, SEXP idsSEXP)
+{
+  using namespace sourcetools;
+  using parser::ParseNode;
+
+  const ParseHandle& handle = parseHandle(handleSEXP);
+  std::vector<index_type> ids = nodeIds(handle, idsSEXP);
+
+  std::vector<ParseNode*> nodes;
+  for (std::vector<index_type>::const_iterator it = ids.begin();
+       it != ids.end();
+       ++it)
+  {
+    nodes.push_back(const_cast<ParseNode*>(handle.node(*it)));
+  }
+
+  return SEXPConverter().asSEXP(nodes);
+}
+
+extern "C" SEXP sourcetools_parse_data(SEXP programSEXP)
+{
+  using namespace sourcetools;
+  using parser::ParseData;
+  using parser::ParseNode;
+  using parser::ParseStatus;
+  using parser::Parser;
+
+  SEXP charSEXP = STRING_ELT(programSEXP, 0);
+  const char* code = CHAR(charSEXP);
+  index_type n = Rf_length(charSEXP);
+
+  Parser parser(code, n);
+  ParseStatus status;
+  scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+  sourcetools::reportErrors(status.getErrors());
+
+  ParseData data(pRoot, code, n);
+  index_type size = data.size();
+
+  // Allocate all columns up front, then fill them in a single pass.
+  r::Protect protect;
+  SEXP resultSEXP = protect(Rf_allocVector(VECSXP, 9));
+  int* line1 = INTEGER(SET_VECTOR_ELT(resultSEXP, 0, Rf_allocVector(INTSXP, size)));
+  int* col1 = INTEGER(SET_VECTOR_ELT(resultSEXP, 1, Rf_allocVector(INTSXP, size)));
+  int* line2 = INTEGER(SET_VECTOR_ELT(resultSEXP, 2, Rf_allocVector(INTSXP, size)));
+  int* col2 = INTEGER(SET_VECTOR_ELT(resultSEXP, 3, Rf_allocVector(INTSXP, size)));
+  int* id = INTEGER(SET_VECTOR_ELT(resultSEXP, 4, Rf_allocVector(INTSXP, size)));
+  int* parent = INTEGER(SET_VECTOR_ELT(resultSEXP, 5, Rf_allocVector(INTSXP, size)));
+  SEXP tokenSEXP = SET_VECTOR_ELT(resultSEXP, 6, Rf_allocVector(STRSXP, size));
+  int* terminal = LOGICAL(SET_VECTOR_ELT(resultSEXP, 7, Rf_allocVector(LGLSXP, size)));
+  SEXP textSEXP = SET_VECTOR_ELT(resultSEXP, 8, Rf_allocVector(STRSXP, size));
+
+  // Token names come from a small fixed set; create each CHARSXP once.
+  std::map<const char*, SEXP> tokenNames;
+
+  for (index_type i = 0; i < size; ++i)
+  {
+    line1[i] = data.line1(i);
+    col1[i] = data.col1(i);
+    line2[i] = data.line2(i);
+    col2[i] = data.col2(i);
+    id[i] = data.id(i);
+    parent[i] = data.parent(i);
+    terminal[i] = data.terminal(i);
+
+    const char* token = data.token(i);
+    std::map<const char*, SEXP>::iterator it = tokenNames.find(token);
+    if (it == tokenNames.end())
+      it = tokenNames.insert(std::make_pair(token, Rf_mkChar(token))).first;
+    SET_STRING_ELT(tokenSEXP, i, it->second);
+
+    SET_STRING_ELT(textSEXP, i, terminal[i]
+      ? Rf_mkCharLenCE(data.textBegin(i), data.textSize(i), CE_UTF8)
+      : R_BlankString);
+  }
+
+  const char* names[] = {
+    "line1", "col1", "line2", "col2", "id", "parent", "token", "terminal", "text"
+  };
+  r::util::setNames(resultSEXP, names, 9);
+  r::util::listToDataFrame(resultSEXP, size);
+
+  return resultSEXP;
+}
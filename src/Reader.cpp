@@ -25,10 +25,62 @@ extern "C" SEXP sourcetools_read(SEXP absolutePathSEXP)
   return resultSEXP;
 }
 
-extern "C" SEXP sourcetools_read_lines(SEXP absolutePathSEXP)
+namespace sourcetools {
+namespace {
+
+// Traits for a character vector whose elements are the lines of a
+// memory mapped file; see 'r::altrep' for details.
+struct LinesVector
+{
+  typedef detail::MemoryMappedLines Object;
+
+  static const char* name() { return "sourcetools_lines"; }
+
+  static R_xlen_t size(const Object& lines)
+  {
+    return lines.size();
+  }
+
+  static SEXP elt(const Object& lines, R_xlen_t i)
+  {
+    const char* begin;
+    const char* end;
+    lines.line(i, &begin, &end);
+    return Rf_mkCharLenCE(begin, end - begin, CE_UTF8);
+  }
+};
+
+SEXP readLinesLazy(const char* absolutePath)
+{
+  scoped_ptr<detail::MemoryMappedLines> pLines(
+    new detail::MemoryMappedLines(absolutePath));
+
+  if (!pLines->open())
+  {
+    Rf_warning("Failed to read file");
+    return R_NilValue;
+  }
+
+#ifdef SOURCETOOLS_R_ALTREP
+  r::Protect protect;
+  detail::MemoryMappedLines* pOwned = pLines.release();
+  SEXP linesSEXP = protect(r::createExternalPointer(pOwned));
+  return r::altrep::String<LinesVector>::create(linesSEXP);
+#else
+  return r::altrep::materialize<LinesVector, STRSXP>(*pLines);
+#endif
+}
+
+} // anonymous namespace
+} // namespace sourcetools
+
+extern "C" SEXP sourcetools_read_lines(SEXP absolutePathSEXP, SEXP lazySEXP)
 {
   const char* absolutePath = CHAR(STRING_ELT(absolutePathSEXP, 0));
 
+  if (Rf_asLogical(lazySEXP) == TRUE)
+    return sourcetools::readLinesLazy(absolutePath);
+
   std::vector<std::string> lines;
   bool result = sourcetools::read_lines(absolutePath, &lines);
   if (!result)
@@ -89,3 +141,11 @@ extern "C" SEXP sourcetools_read_lines_bytes(SEXP absolutePathSEXP)
   }
   return resultSEXP;
 }
+
+extern "C" void sourcetools_init_read(DllInfo* dll)
+{
+#ifdef SOURCETOOLS_R_ALTREP
+  using namespace sourcetools;
+  r::altrep::String<LinesVector>::init(dll);
+#endif
+}
@@ -7,6 +7,153 @@
 namespace sourcetools {
 namespace {
 
+// A compact, column-oriented representation of a token stream. Tokens
+// refer to the source buffer by offset, so that the R-level 'value'
+// column can be materialized lazily (one CHARSXP per accessed element)
+// rather than eagerly for every token.
+class TokenTable : noncopyable
+{
+public:
+
+  typedef tokens::Token Token;
+  typedef tokens::TokenType TokenType;
+
+  // Tokenize a buffer owned by R (e.g. a CHARSXP). The caller is
+  // responsible for keeping that buffer alive for the table's lifetime.
+  TokenTable(const char* code, index_type n)
+    : code_(code)
+  {
+    tokenize(n);
+  }
+
+  // Tokenize a buffer owned by this table. When a cache entry is given,
+  // the tokens are taken from it instead, unless it doesn't fit the
+  // contents.
+  explicit TokenTable(std::string* pContents, const cache::Entry* pEntry = NULL)
+  {
+    contents_.swap(*pContents);
+    code_ = contents_.data();
+    if (pEntry == NULL || !load(*pEntry))
+      tokenize(contents_.size());
+  }
+
+  void store(cache::Entry* pEntry) const
+  {
+    std::vector< std::vector<int> >& columns = pEntry->columns;
+    columns.resize(5);
+    columns[0] = offsets_;
+    columns[1] = sizes_;
+    columns[2] = rows_;
+    columns[3] = columns_;
+    columns[4].assign(types_.begin(), types_.end());
+  }
+
+  index_type size() const { return utils::size(offsets_); }
+
+  int row(index_type i) const { return rows_[i]; }
+  int column(index_type i) const { return columns_[i]; }
+  TokenType type(index_type i) const { return types_[i]; }
+
+  SEXP value(index_type i) const
+  {
+    return Rf_mkCharLenCE(code_ + offsets_[i], sizes_[i], CE_UTF8);
+  }
+
+  SEXP typeName(index_type i) const
+  {
+    return r::createChar(toString(types_[i]));
+  }
+
+private:
+
+  void tokenize(index_type n)
+  {
+    if (n == 0)
+      return;
+
+    Token token;
+    tokenizer::Tokenizer tokenizer(code_, n);
+    while (tokenizer.tokenize(&token))
+    {
+      offsets_.push_back(token.offset());
+      sizes_.push_back(token.size());
+      rows_.push_back(token.row() + 1);
+      columns_.push_back(token.column() + 1);
+      types_.push_back(token.type());
+    }
+  }
+
+  bool load(const cache::Entry& entry)
+  {
+    const std::vector< std::vector<int> >& columns = entry.columns;
+    if (columns.size() != 5)
+      return false;
+
+    index_type n = utils::size(columns[0]);
+    for (index_type i = 1; i < 5; ++i)
+      if (utils::size(columns[i]) != n)
+        return false;
+
+    index_type size = utils::size(contents_);
+    for (index_type i = 0; i < n; ++i)
+    {
+      index_type offset = columns[0][i];
+      if (offset < 0 || columns[1][i] < 0 || columns[1][i] > size - offset)
+        return false;
+    }
+
+    offsets_ = columns[0];
+    sizes_ = columns[1];
+    rows_ = columns[2];
+    columns_ = columns[3];
+    types_.assign(columns[4].begin(), columns[4].end());
+    return true;
+  }
+
+  std::string contents_;
+  const char* code_;
+
+  std::vector<index_type> offsets_;
+  std::vector<index_type> sizes_;
+  std::vector<int> rows_;
+  std::vector<int> columns_;
+  std::vector<TokenType> types_;
+};
+
+// Traits describing how each column of the token data frame is
+// produced from the token table; see 'r::altrep' for details.
+struct ValueColumn
+{
+  typedef TokenTable Object;
+  static const char* name() { return "sourcetools_token_value"; }
+  static R_xlen_t size(const TokenTable& table) { return table.size(); }
+  static SEXP elt(const TokenTable& table, R_xlen_t i) { return table.value(i); }
+};
+
+struct TypeColumn
+{
+  typedef TokenTable Object;
+  static const char* name() { return "sourcetools_token_type"; }
+  static R_xlen_t size(const TokenTable& table) { return table.size(); }
+  static SEXP elt(const TokenTable& table, R_xlen_t i) { return table.typeName(i); }
+};
+
+struct RowColumn
+{
+  typedef TokenTable Object;
+  static const char* name() { return "sourcetools_token_row"; }
+  static R_xlen_t size(const TokenTable& table) { return table.size(); }
+  static int elt(const TokenTable& table, R_xlen_t i) { return table.row(i); }
+};
+
+struct ColumnColumn
+{
+  typedef TokenTable Object;
+  static const char* name() { return "sourcetools_token_column"; }
+  static R_xlen_t size(const TokenTable& table) { return table.size(); }
+  static int elt(const TokenTable& table, R_xlen_t i) { return table.column(i); }
+};
+
 void asDataFrame(SEXP listSEXP, int n)
 {
   r::Protect protect;
@@ -19,36 +166,36 @@ void asDataFrame(SEXP listSEXP, int n)
   Rf_setAttrib(listSEXP, R_RowNamesSymbol, rownamesSEXP);
 }
 
-SEXP asSEXP(const std::vector<tokens::Token>& tokens)
+// Takes ownership of 'pTable'. 'sourceSEXP' is kept alive for as long
+// as any of the returned columns refer to the token table.
+//
+// The table is handed to an external pointer before anything else is
+// allocated, so that it is freed by the garbage collector even if a
+// later allocation fails and R unwinds past this frame.
+SEXP asSEXP(TokenTable* pTable, SEXP sourceSEXP = R_NilValue)
 {
   r::Protect protect;
-  index_type n = tokens.size();
+  SEXP tableSEXP = protect(r::createExternalPointer(pTable, R_NilValue, sourceSEXP));
+
+  index_type n = pTable->size();
   SEXP resultSEXP = protect(Rf_allocVector(VECSXP, 4));
 
-  // Set vector elements
-  SEXP valueSEXP = protect(Rf_allocVector(STRSXP, n));
-  SET_VECTOR_ELT(resultSEXP, 0, valueSEXP);
-  for (index_type i = 0; i < n; ++i) {
-    const std::string& contents = tokens[i].contents();
-    SET_STRING_ELT(valueSEXP, i, r::createChar(contents));
-  }
+#ifdef SOURCETOOLS_R_ALTREP
+  SET_VECTOR_ELT(resultSEXP, 0, r::altrep::String<ValueColumn>::create(tableSEXP));
+  SET_VECTOR_ELT(resultSEXP, 1, r::altrep::Integer<RowColumn>::create(tableSEXP));
+  SET_VECTOR_ELT(resultSEXP, 2, r::altrep::Integer<ColumnColumn>::create(tableSEXP));
+  SET_VECTOR_ELT(resultSEXP, 3, r::altrep::String<TypeColumn>::create(tableSEXP));
+#else
+  const TokenTable& table = *pTable;
+  SET_VECTOR_ELT(resultSEXP, 0, r::altrep::materialize<ValueColumn, STRSXP>(table));
+  SET_VECTOR_ELT(resultSEXP, 1, r::altrep::materialize<RowColumn, INTSXP>(table));
+  SET_VECTOR_ELT(resultSEXP, 2, r::altrep::materialize<ColumnColumn, INTSXP>(table));
+  SET_VECTOR_ELT(resultSEXP, 3, r::altrep::materialize<TypeColumn, STRSXP>(table));
 
-  SEXP rowSEXP = protect(Rf_allocVector(INTSXP, n));
-  SET_VECTOR_ELT(resultSEXP, 1, rowSEXP);
-  for (index_type i = 0; i < n; ++i)
-    INTEGER(rowSEXP)[i] = tokens[i].row() + 1;
-
-  SEXP columnSEXP = protect(Rf_allocVector(INTSXP, n));
-  SET_VECTOR_ELT(resultSEXP, 2, columnSEXP);
-  for (index_type i = 0; i < n; ++i)
-    INTEGER(columnSEXP)[i] = tokens[i].column() + 1;
-
-  SEXP typeSEXP = protect(Rf_allocVector(STRSXP, n));
-  SET_VECTOR_ELT(resultSEXP, 3, typeSEXP);
-  for (index_type i = 0; i < n; ++i) {
-    const std::string& type = toString(tokens[i].type());
-    SET_STRING_ELT(typeSEXP, i, r::createChar(type));
-  }
+  // The columns hold copies, so the table can go now.
+  delete pTable;
+  R_ClearExternalPtr(tableSEXP);
+#endif
 
   // Set names
   SEXP namesSEXP = protect(Rf_allocVector(STRSXP, 4));
@@ -68,32 +215,76 @@ SEXP asSEXP(const std::vector<tokens::Token>& tokens)
 } // anonymous namespace
 } // namespace sourcetools
 
-extern "C" SEXP sourcetools_tokenize_file(SEXP absolutePathSEXP)
+extern "C" SEXP sourcetools_tokenize_file(SEXP absolutePathSEXP, SEXP cacheSEXP)
 {
-  typedef sourcetools::tokens::Token Token;
+  using namespace sourcetools;
 
-  const char* absolutePath = CHAR(STRING_ELT(absolutePathSEXP, 0));
-  std::string contents;
-  if (!sourcetools::read(absolutePath, &contents))
+  // Everything owned here is released before calling back into R.
+  bool ok;
+  TokenTable* pTable = NULL;
+  {
+    const char* absolutePath = CHAR(STRING_ELT(absolutePathSEXP, 0));
+    scoped_ptr<cache::DiskCache> pCache(r::createDiskCache(cacheSEXP));
+
+    std::string contents;
+    hash_type contentHash = 0;
+    ok = pCache == NULL
+      ? sourcetools::read(absolutePath, &contents)
+      : pCache->hashFile(absolutePath, &contentHash, &contents);
+
+    if (ok && !contents.empty())
+    {
+      if (pCache == NULL)
+      {
+        pTable = new TokenTable(&contents);
+      }
+      else
+      {
+        hash_type key = pCache->key("tokens", contentHash);
+        cache::Entry entry;
+        bool cached = pCache->read(key, &entry);
+
+        pTable = new TokenTable(&contents, cached ? &entry : NULL);
+        if (!cached)
+        {
+          pTable->store(&entry);
+          pCache->write(key, entry);
+        }
+      }
+    }
+  }
+
+  if (!ok)
   {
     Rf_warning("Failed to read file");
     return R_NilValue;
   }
 
-  if (contents.empty()) return R_NilValue;
-  const std::vector<Token>& tokens = sourcetools::tokenize(contents);
-  return sourcetools::asSEXP(tokens);
+  if (pTable == NULL)
+    return R_NilValue;
+
+  return asSEXP(pTable);
 }
 
 extern "C" SEXP sourcetools_tokenize_string(SEXP stringSEXP)
 {
-  typedef sourcetools::tokens::Token Token;
+  using sourcetools::TokenTable;
 
   if (Rf_length(stringSEXP) == 0)
-    return sourcetools::asSEXP(std::vector<Token>());
+    return sourcetools::asSEXP(new TokenTable(NULL, 0));
 
   SEXP charSEXP = STRING_ELT(stringSEXP, 0);
-  const std::vector<Token>& tokens =
-    sourcetools::tokenize(CHAR(charSEXP), Rf_length(charSEXP));
-  return sourcetools::asSEXP(tokens);
+  TokenTable* pTable = new TokenTable(CHAR(charSEXP), Rf_length(charSEXP));
+  return sourcetools::asSEXP(pTable, charSEXP);
+}
+
+extern "C" void sourcetools_init_tokenize(DllInfo* dll)
+{
+#ifdef SOURCETOOLS_R_ALTREP
+  using namespace sourcetools;
+  r::altrep::String<ValueColumn>::init(dll);
+  r::altrep::String<TypeColumn>::init(dll);
+  r::altrep::Integer<RowColumn>::init(dll);
+  r::altrep::Integer<ColumnColumn>::init(dll);
+#endif
 }
@@ -3,12 +3,12 @@ using namespace sourcetools;
 
 namespace {
 
-typedef sourcetools::validators::SyntaxError Error;
+typedef sourcetools::parser::ParseError Error;
 struct RowSetter
 {
   void operator()(SEXP dataSEXP, index_type i, const Error& error)
   {
-    INTEGER(dataSEXP)[i] = error.row() + 1;
+    INTEGER(dataSEXP)[i] = error.start().row + 1;
   }
 };
 
@@ -16,7 +16,7 @@ struct ColSetter
 {
   void operator()(SEXP dataSEXP, index_type i, const Error& error)
   {
-    INTEGER(dataSEXP)[i] = error.column() + 1;
+    INTEGER(dataSEXP)[i] = error.start().column + 1;
   }
 };
 
@@ -34,18 +34,23 @@ struct ErrSetter
 
 extern "C" SEXP sourcetools_validate_syntax(SEXP contentsSEXP) {
   using namespace sourcetools;
-  using namespace sourcetools::tokens;
-  using namespace sourcetools::validators;
+  using namespace sourcetools::parser;
 
   r::Protect protect;
   if (Rf_length(contentsSEXP) == 0)
     contentsSEXP = protect(Rf_mkString(""));
 
-  const char* contents = CHAR(STRING_ELT(contentsSEXP, 0));
-  const std::vector<tokens::Token>& tokens = sourcetools::tokenize(contents);
+  SEXP charSEXP = STRING_ELT(contentsSEXP, 0);
 
-  SyntaxValidator validator(tokens);
-  const std::vector<SyntaxError>& errors = validator.errors();
+  // Run the parser without building a parse tree; we only want errors.
+  ParseOptions options;
+  options.buildTree = false;
+  Parser parser(CHAR(charSEXP), Rf_length(charSEXP), options);
+
+  ParseStatus status;
+  parser.parse(&status);
+
+  const std::vector<ParseError>& errors = status.getErrors();
   index_type n = errors.size();
 
   r::RObjectFactory factory;
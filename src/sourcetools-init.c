@@ -9,29 +9,69 @@
 
 /* .Call calls */
 extern SEXP run_testthat_tests();
-extern SEXP sourcetools_diagnose_string(SEXP);
-extern SEXP sourcetools_parse_string(SEXP);
+extern SEXP sourcetools_benchmark_dispatch(SEXP, SEXP, SEXP, SEXP);
+extern SEXP sourcetools_deserialize_parse(SEXP);
+extern SEXP sourcetools_diagnose_file(SEXP, SEXP, SEXP);
+extern SEXP sourcetools_diagnose_files(SEXP, SEXP, SEXP);
+extern SEXP sourcetools_diagnose_session();
+extern SEXP sourcetools_diagnose_session_update(SEXP, SEXP);
+extern SEXP sourcetools_diagnose_string(SEXP, SEXP);
+extern SEXP sourcetools_diagnose_strings(SEXP, SEXP);
+extern SEXP sourcetools_find_nse_files(SEXP, SEXP);
+extern SEXP sourcetools_nse_cache_reset(SEXP);
+extern SEXP sourcetools_nse_cache_stats();
+extern SEXP sourcetools_parse_data(SEXP);
+extern SEXP sourcetools_parse_file(SEXP, SEXP, SEXP);
+extern SEXP sourcetools_parse_handle(SEXP);
+extern SEXP sourcetools_parse_handle_children(SEXP, SEXP);
+extern SEXP sourcetools_parse_handle_convert(SEXP, SEXP);
+extern SEXP sourcetools_parse_handle_nodes(SEXP, SEXP);
+extern SEXP sourcetools_parse_string(SEXP, SEXP);
 extern SEXP sourcetools_performs_nse(SEXP);
 extern SEXP sourcetools_read(SEXP);
 extern SEXP sourcetools_read_bytes(SEXP);
-extern SEXP sourcetools_read_lines(SEXP);
+extern SEXP sourcetools_read_lines(SEXP, SEXP);
 extern SEXP sourcetools_read_lines_bytes(SEXP);
-extern SEXP sourcetools_tokenize_file(SEXP);
+extern SEXP sourcetools_serialize_parse(SEXP);
+extern SEXP sourcetools_symbol_index(SEXP, SEXP);
+extern SEXP sourcetools_tokenize_file(SEXP, SEXP);
 extern SEXP sourcetools_tokenize_string(SEXP);
 extern SEXP sourcetools_validate_syntax(SEXP);
 
+/* ALTREP class registration */
+extern void sourcetools_init_read(DllInfo *dll);
+extern void sourcetools_init_tokenize(DllInfo *dll);
+
 static const R_CallMethodDef CallEntries[] = {
-    {"run_testthat_tests",           (DL_FUNC) &run_testthat_tests,           0},
-    {"sourcetools_diagnose_string",  (DL_FUNC) &sourcetools_diagnose_string,  1},
-    {"sourcetools_parse_string",     (DL_FUNC) &sourcetools_parse_string,     1},
-    {"sourcetools_performs_nse",     (DL_FUNC) &sourcetools_performs_nse,     1},
-    {"sourcetools_read",             (DL_FUNC) &sourcetools_read,             1},
-    {"sourcetools_read_bytes",       (DL_FUNC) &sourcetools_read_bytes,       1},
-    {"sourcetools_read_lines",       (DL_FUNC) &sourcetools_read_lines,       1},
-    {"sourcetools_read_lines_bytes", (DL_FUNC) &sourcetools_read_lines_bytes, 1},
-    {"sourcetools_tokenize_file",    (DL_FUNC) &sourcetools_tokenize_file,    1},
-    {"sourcetools_tokenize_string",  (DL_FUNC) &sourcetools_tokenize_string,  1},
-    {"sourcetools_validate_syntax",  (DL_FUNC) &sourcetools_validate_syntax,  1},
+    {"run_testthat_tests",                  (DL_FUNC) &run_testthat_tests,                  0},
+    {"sourcetools_benchmark_dispatch",      (DL_FUNC) &sourcetools_benchmark_dispatch,      4},
+    {"sourcetools_deserialize_parse",       (DL_FUNC) &sourcetools_deserialize_parse,       1},
+    {"sourcetools_diagnose_file",           (DL_FUNC) &sourcetools_diagnose_file,           3},
+    {"sourcetools_diagnose_files",          (DL_FUNC) &sourcetools_diagnose_files,          3},
+    {"sourcetools_diagnose_session",        (DL_FUNC) &sourcetools_diagnose_session,        0},
+    {"sourcetools_diagnose_session_update", (DL_FUNC) &sourcetools_diagnose_session_update, 2},
+    {"sourcetools_diagnose_string",         (DL_FUNC) &sourcetools_diagnose_string,         2},
+    {"sourcetools_diagnose_strings",        (DL_FUNC) &sourcetools_diagnose_strings,        2},
+    {"sourcetools_find_nse_files",          (DL_FUNC) &sourcetools_find_nse_files,          2},
+    {"sourcetools_nse_cache_reset",         (DL_FUNC) &sourcetools_nse_cache_reset,         1},
+    {"sourcetools_nse_cache_stats",         (DL_FUNC) &sourcetools_nse_cache_stats,         0},
+    {"sourcetools_parse_data",              (DL_FUNC) &sourcetools_parse_data,              1},
+    {"sourcetools_parse_file",              (DL_FUNC) &sourcetools_parse_file,              3},
+    {"sourcetools_parse_handle",            (DL_FUNC) &sourcetools_parse_handle,            1},
+    {"sourcetools_parse_handle_children",   (DL_FUNC) &sourcetools_parse_handle_children,   2},
+    {"sourcetools_parse_handle_convert",    (DL_FUNC) &sourcetools_parse_handle_convert,    2},
+    {"sourcetools_parse_handle_nodes",      (DL_FUNC) &sourcetools_parse_handle_nodes,      2},
+    {"sourcetools_parse_string",            (DL_FUNC) &sourcetools_parse_string,            2},
+    {"sourcetools_performs_nse",            (DL_FUNC) &sourcetools_performs_nse,            1},
+    {"sourcetools_read",                    (DL_FUNC) &sourcetools_read,                    1},
+    {"sourcetools_read_bytes",              (DL_FUNC) &sourcetools_read_bytes,              1},
+    {"sourcetools_read_lines",              (DL_FUNC) &sourcetools_read_lines,              2},
+    {"sourcetools_read_lines_bytes",        (DL_FUNC) &sourcetools_read_lines_bytes,        1},
+    {"sourcetools_serialize_parse",         (DL_FUNC) &sourcetools_serialize_parse,         1},
+    {"sourcetools_symbol_index",            (DL_FUNC) &sourcetools_symbol_index,            2},
+    {"sourcetools_tokenize_file",           (DL_FUNC) &sourcetools_tokenize_file,           2},
+    {"sourcetools_tokenize_string",         (DL_FUNC) &sourcetools_tokenize_string,         1},
+    {"sourcetools_validate_syntax",         (DL_FUNC) &sourcetools_validate_syntax,         1},
     {NULL, NULL, 0}
 };
 
@@ -39,4 +79,6 @@ void R_init_sourcetools(DllInfo *dll)
 {
     R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
     R_useDynamicSymbols(dll, FALSE);
+    sourcetools_init_read(dll);
+    sourcetools_init_tokenize(dll);
 }
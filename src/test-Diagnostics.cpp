@@ -0,0 +1,242 @@
+#include <testthat.h>
+#include <sourcetools.h>
+
+using namespace sourcetools;
+using namespace sourcetools::parser;
+using namespace sourcetools::diagnostics;
+
+typedef sourcetools::tokens::TokenType TokenType;
+
+namespace {
+
+// Records the nodes it is applied to, optionally restricted to a
+// single token type.
+class RecordingChecker : public checkers::CheckerBase
+{
+public:
+
+  RecordingChecker(std::vector<int>* pLog, int id, TokenType type, bool typed)
+    : pLog_(pLog), id_(id), type_(type), typed_(typed)
+  {
+  }
+
+  void tokenTypes(std::vector<TokenType>* pTypes) const
+  {
+    if (typed_)
+      pTypes->push_back(type_);
+  }
+
+  void apply(const ParseNode* pNode, Diagnostics* pDiagnostics, index_type depth)
+  {
+    if (!pNode->token().isType(type_))
+      return;
+
+    pLog_->push_back(id_);
+  }
+
+private:
+  std::vector<int>* pLog_;
+  int id_;
+  TokenType type_;
+  bool typed_;
+};
+
+void runCheckers(const std::string& code, bool typed, std::vector<int>* pLog)
+{
+  using namespace tokens;
+
+  static const TokenType types[] = {
+    SYMBOL, NUMBER, STRING, OPERATOR_ASSIGN_LEFT, OPERATOR_PLUS,
+    OPERATOR_EQUAL, LPAREN, LBRACE, KEYWORD_IF, KEYWORD_FUNCTION
+  };
+
+  Parser parser(code);
+  ParseStatus status;
+  scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+
+  DiagnosticsSet set;
+  for (int i = 0; i < 60; ++i)
+  {
+    TokenType type = types[i % (sizeof(types) / sizeof(types[0]))];
+    // Mix typed and untyped checkers, so that each table entry has to
+    // interleave them in the order they were added.
+    set.add(new RecordingChecker(pLog, i, type, typed && i % 3 != 0));
+  }
+
+  set.run(pRoot);
+}
+
+} // anonymous namespace
+
+context("Diagnostics") {
+
+  test_that("checkers are dispatched by token type in order")
+  {
+    std::string code =
+      "f <- function(x = 1) { if (x == 'a') g(x + 1) else { y <- -x } }";
+
+    std::vector<int> typed, untyped;
+    runCheckers(code, true, &typed);
+    runCheckers(code, false, &untyped);
+
+    expect_true(!typed.empty());
+    expect_true(typed == untyped);
+  }
+
+  test_that("symbols are resolved to the scopes defining them")
+  {
+    std::string code =
+      "f <- function(x) { y <- x; g <- function() y <<- z; z <- 1 }";
+
+    Parser parser(code);
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+    ScopeAnalysis scopes(pRoot);
+
+    const std::vector<ScopeAnalysis::Reference>& references = scopes.references();
+    expect_true(scopes.scopes().size() == 3);
+    expect_true(references.size() == 2);
+
+    // 'x' refers to the formal of 'f', and 'z' to the local defined
+    // after the inner function.
+    for (index_type i = 0; i < utils::size(references); ++i)
+    {
+      const ScopeAnalysis::Reference& reference = references[i];
+      const ScopeAnalysis::Binding& binding = scopes.bindings()[reference.binding];
+      expect_true(binding.scope == 1);
+      expect_true(binding.name == reference.name);
+      expect_true(scopes.reference(reference.pNode) == i);
+    }
+
+    // 'y <<- z' assigns the 'y' local to 'f', which counts as a use.
+    index_type uses = -1;
+    for (index_type i = 0; i < utils::size(scopes.bindings()); ++i)
+    {
+      const ScopeAnalysis::Binding& binding = scopes.bindings()[i];
+      if (scopes.name(binding.name) == "y" && binding.scope == 1)
+        uses = binding.uses;
+    }
+    expect_true(uses == 1);
+  }
+
+  test_that("'assign()' only binds names in the calling function")
+  {
+    std::string code =
+      "f <- function() {\n"
+      "  assign('x', 1)\n"
+      "  assign('y', 1, envir = globalenv())\n"
+      "  assign('z', value = 1, inherits = TRUE)\n"
+      "}\n";
+
+    Parser parser(code);
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+    ScopeAnalysis scopes(pRoot);
+
+    std::vector<std::string> locals;
+    for (index_type i = 0; i < utils::size(scopes.bindings()); ++i)
+    {
+      const ScopeAnalysis::Binding& binding = scopes.bindings()[i];
+      if (binding.scope == 1)
+        locals.push_back(scopes.name(binding.name));
+    }
+
+    expect_true(locals.size() == 1);
+    expect_true(locals[0] == "x");
+  }
+
+  test_that("deeply nested code is diagnosed without recursion")
+  {
+    static const int n = 30000;
+
+    std::string code;
+    for (int i = 0; i < n; ++i)
+      code += "x <- (";
+    code += "undefined";
+    for (int i = 0; i < n; ++i)
+      code += ")";
+
+    Parser parser(code);
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(parser.parse(&status));
+    expect_true(status.getErrors().empty());
+
+    r::SearchPathObjects objects;
+    scoped_ptr<DiagnosticsSet> pSet(createDefaultDiagnosticsSet(objects));
+    const std::vector<Diagnostic>& diagnostics = pSet->run(pRoot);
+    expect_true(diagnostics.size() == 1);
+    expect_true(diagnostics[0].start().column == n * 6);
+  }
+
+  test_that("sessions only check the expressions affected by an edit")
+  {
+    r::SearchPathObjects objects;
+    DiagnosticsSession session;
+
+    std::string code =
+      "f <- function(x) g(x)\n"
+      "h <- function() { y <- 1 }\n"
+      "k <- function() 1\n";
+
+    std::vector<Diagnostic> diagnostics = session.run(code, objects);
+    expect_true(session.checked() == 3);
+    expect_true(diagnostics.size() == 2);
+
+    // Editing one expression, and moving the others, only checks it again.
+    code =
+      "f <- function(x) g(x)\n"
+      "\n"
+      "h <- function() { y <- 2 }\n"
+      "k <- function() 1\n";
+
+    diagnostics = session.run(code, objects);
+    expect_true(session.checked() == 1);
+    expect_true(diagnostics.size() == 2);
+    expect_true(diagnostics[1].start().row == 2);
+    expect_true(diagnostics[1].start().column == 18);
+
+    // Defining 'g' also checks the expression that refers to it.
+    code += "g <- function(x) x\n";
+    diagnostics = session.run(code, objects);
+    expect_true(session.checked() == 2);
+    expect_true(diagnostics.size() == 1);
+  }
+
+  test_that("functions performing non-standard evaluation are found from source")
+  {
+    std::vector<std::string> files;
+    files.push_back(
+      "quoter <- function(x) substitute(x)\n"
+      "forwarder <- function(...) quoter(...)\n"
+      "plain <- function(x) quoter(x)\n");
+    files.push_back(
+      "indirect = function(...) forwarder(x = ...)\n"
+      "ping <- pong <- function(...) ping(...)\n"
+      "tidy <- function(...) rlang::enquos(...)\n"
+      "x <- 1\n");
+
+    std::vector<NseFunction> functions;
+    for (index_type i = 0; i < utils::size(files); ++i)
+    {
+      ParseStatus status;
+      scoped_ptr<ParseNode> pRoot(Parser(files[i]).parse(&status));
+      findNseFunctions(pRoot, i, &functions);
+    }
+
+    propagateNse(&functions);
+
+    const char* names[] = {"quoter", "forwarder", "plain", "indirect", "ping", "pong", "tidy"};
+    bool expected[] = {true, true, false, true, false, false, true};
+
+    expect_true(functions.size() == 7);
+    for (index_type i = 0; i < 7 && i < utils::size(functions); ++i)
+    {
+      expect_true(functions[i].name == names[i]);
+      expect_true(functions[i].status == expected[i]);
+    }
+
+    expect_true(functions[3].file == 1);
+    expect_true(functions[5].position.column == 8);
+  }
+
+}
@@ -1,5 +1,6 @@
 #include <testthat.h>
 #include <sourcetools.h>
+#include <sourcetools/thread/thread.h>
 
 using namespace sourcetools;
 using namespace sourcetools::parser;
@@ -8,6 +9,121 @@ using namespace sourcetools::collections;
 
 typedef sourcetools::tokens::Token Token;
 
+namespace {
+
+// Generates a small program, varying with 'seed'; some have errors.
+std::string program(int seed)
+{
+  static const char* const snippets[] = {
+    "f <- function(x, y = 1) { if (x > y) x else y }\n",
+    "for (i in seq_len(n)) total <- total + i\n",
+    "x %>% filter(a == 1) %>% summarise(n = n())\n",
+    "g <- function(...) list(...)[[1L]]$value\n",
+    "while (TRUE) { if (done) break else next }\n",
+    "y <- c(1, 2, 3)[-1] * 2 ^ 3\n",
+    "h <- function(x) { z <- x; undefined + 1 }\n",
+    "r\"(raw string)\" |> nchar()\n",
+    "if (x == NULL) stop('oops')\n",
+    "f(a = , b = 2, )\n",
+    "x <- (1 + \n",
+    "}\n"
+  };
+
+  static const int n = sizeof(snippets) / sizeof(snippets[0]);
+
+  std::string code;
+  for (int i = 0; i < 1 + seed % 7; ++i)
+    code += snippets[(seed * 31 + i * 17) % n];
+  return code;
+}
+
+// Tokenizes, parses, serializes and diagnoses a program, summarizing
+// everything found as a string, so that results can be compared.
+std::string summarize(const std::string& code, const r::SearchPathObjects& objects)
+{
+  std::string result;
+
+  const std::vector<Token>& tokens = tokenize(code);
+  for (std::vector<Token>::const_iterator it = tokens.begin();
+       it != tokens.end();
+       ++it)
+  {
+    result += toString(*it);
+  }
+
+  ParseStatus status;
+  scoped_ptr<ParseNode> pRoot(Parser(code).parse(&status));
+  serialize::write(code.data(), utils::size(code), pRoot, status.getErrors(), &result);
+
+  scoped_ptr<diagnostics::DiagnosticsSet> pSet(
+    diagnostics::createDefaultDiagnosticsSet(objects));
+  const std::vector<diagnostics::Diagnostic>& diagnostics = pSet->run(pRoot);
+  for (std::vector<diagnostics::Diagnostic>::const_iterator it = diagnostics.begin();
+       it != diagnostics.end();
+       ++it)
+  {
+    result += it->message();
+  }
+
+  return result;
+}
+
+class SummarizeWorker : public thread::Worker
+{
+public:
+
+  SummarizeWorker(const std::vector<std::string>& programs,
+                  const r::SearchPathObjects& objects,
+                  std::vector<std::string>* pResults)
+    : programs_(programs), objects_(objects), pResults_(pResults)
+  {
+  }
+
+  void operator()(index_type i)
+  {
+    (*pResults_)[i] = summarize(programs_[i], objects_);
+  }
+
+private:
+  const std::vector<std::string>& programs_;
+  const r::SearchPathObjects& objects_;
+  std::vector<std::string>* pResults_;
+};
+
+// Nests 'n' copies of a construct, e.g. 'list(list(list(1)))'.
+std::string nested(const char* open, const char* close, int n)
+{
+  std::string code;
+  for (int i = 0; i < n; ++i)
+    code += open;
+  code += "1";
+  for (int i = 0; i < n; ++i)
+    code += close;
+  return code;
+}
+
+// The depth of a tree, found without recursion.
+int depth(const ParseNode* pRoot)
+{
+  int result = 0;
+  std::vector< std::pair<const ParseNode*, int> > stack;
+  stack.push_back(std::make_pair(pRoot, 0));
+  while (!stack.empty())
+  {
+    const ParseNode* pNode = stack.back().first;
+    int level = stack.back().second;
+    stack.pop_back();
+
+    result = std::max(result, level);
+    const std::vector<ParseNode*>& children = pNode->children();
+    for (std::size_t i = 0; i < children.size(); ++i)
+      stack.push_back(std::make_pair(children[i], level + 1));
+  }
+  return result;
+}
+
+} // anonymous namespace
+
 context("Parser") {
 
   test_that("we can extract partial parse trees from code")
@@ -15,7 +131,9 @@ context("Parser") {
     std::string code = "foo <- function(a = {1 + 2}) {}";
 
     std::vector<Token> tokens = tokenize(code);
-    Parser parser(code);
+    ParseOptions options;
+    options.recordLocations = true;
+    Parser parser(code, options);
 
     ParseStatus status;
     scoped_ptr<ParseNode> pRoot(parser.parse(&status));
@@ -46,6 +164,213 @@ context("Parser") {
     pTarget->bounds(&begin, &end);
     contents = std::string(begin, end);
     expect_true(contents == "{1 + 2}");
+
+    // The smallest node enclosing '1 + 2' is the '+' call itself, and
+    // the smallest enclosing 'a = {' is the argument.
+    Position start = cursor.position() + 1;
+    const ParseNode* pEnclosing =
+      status.getSmallestEnclosingNode(start, start + 5);
+    expect_true((pEnclosing != NULL));
+    expect_true((pEnclosing->token().contentsEqual("+")));
+
+    pEnclosing = status.getSmallestEnclosingNode(position, cursor.position() + 1);
+    expect_true((pEnclosing != NULL));
+    expect_true((pEnclosing->token().contentsEqual("=")));
+
+    expect_true((status.getNodeAtPosition(Position(10, 0)) == NULL));
+  }
+
+  test_that("deferred range computation matches eager propagation")
+  {
+    std::string code =
+      "f <- function(x, y = 1) {\n"
+      "  if (x) g(y)[[1]] else if (y) -x else {\n"
+      "    x %>% h() %>% k(a = 1)\n"
+      "  }\n"
+      "}\n";
+
+    ParseOptions eager;
+    ParseOptions deferred;
+    deferred.deferRanges = true;
+
+    ParseStatus status;
+    scoped_ptr<ParseNode> pEager(Parser(code, eager).parse(&status));
+    scoped_ptr<ParseNode> pDeferred(Parser(code, deferred).parse(&status));
+
+    std::vector<const ParseNode*> lhs(1, pEager);
+    std::vector<const ParseNode*> rhs(1, pDeferred);
+    while (!lhs.empty() && !rhs.empty())
+    {
+      const ParseNode* pLhs = lhs.back(); lhs.pop_back();
+      const ParseNode* pRhs = rhs.back(); rhs.pop_back();
+
+      expect_true(pLhs->begin().offset() == pRhs->begin().offset());
+      expect_true(pLhs->end().offset() == pRhs->end().offset());
+
+      lhs.insert(lhs.end(), pLhs->children().begin(), pLhs->children().end());
+      rhs.insert(rhs.end(), pRhs->children().begin(), pRhs->children().end());
+    }
+
+    expect_true(lhs.empty() && rhs.empty());
+  }
+
+  test_that("operator chains are parsed without recursion")
+  {
+    std::string code = "x";
+    for (int i = 0; i < 100000; ++i)
+      code += " <- x";
+
+    ParseOptions options;
+    options.buildTree = false;
+
+    ParseStatus status;
+    Parser(code, options).parse(&status);
+    expect_true(status.getErrors().empty());
+  }
+
+  test_that("nesting deeper than the maximum depth is an error")
+  {
+    std::string code;
+    for (int i = 0; i < 100; ++i)
+      code += "f(";
+    for (int i = 0; i < 100; ++i)
+      code += ")";
+
+    ParseOptions options;
+    options.maxDepth = 50;
+
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(Parser(code, options).parse(&status));
+
+    const std::vector<ParseError>& errors = status.getErrors();
+    expect_true(errors.size() == 1);
+    expect_true(errors[0].message() == "maximum nesting depth exceeded");
+  }
+
+  test_that("deeply nested constructs are parsed without recursion")
+  {
+    static const int n = 30000;
+    static const char* const constructs[][2] = {
+      { "list(",              ")" },
+      { "x[",                 "]" },
+      { "f(a = ",             ")" },
+      { "{",                  "}" },
+      { "(",                  ")" },
+      { "-(",                 ")" },
+      { "if (a) b else ",     ""  },
+      { "function(x) ",       ""  },
+      { "for (i in x) ",      ""  },
+      { "while (TRUE) ",      ""  },
+      { "repeat ",            ""  },
+      { "{ if (a) list(b, ",  ") }" }
+    };
+
+    for (std::size_t i = 0; i < sizeof(constructs) / sizeof(constructs[0]); ++i)
+    {
+      std::string code = nested(constructs[i][0], constructs[i][1], n);
+
+      ParseStatus status;
+      scoped_ptr<ParseNode> pRoot(Parser(code).parse(&status));
+      expect_true(status.getErrors().empty());
+      expect_true(pRoot->children().size() == 1);
+      expect_true(depth(pRoot) >= n);
+    }
+  }
+
+  test_that("nesting beyond the default maximum depth is an error")
+  {
+    std::string code = nested("(", ")", ParseOptions().maxDepth + 1);
+
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(Parser(code).parse(&status));
+
+    const std::vector<ParseError>& errors = status.getErrors();
+    expect_true(errors.size() == 1);
+    expect_true(errors[0].message() == "maximum nesting depth exceeded");
+  }
+
+  test_that("deeply nested trees are destroyed without recursion")
+  {
+    std::string code = "x";
+    for (int i = 0; i < 100000; ++i)
+      code += " <- x";
+
+    ParseStatus status;
+    scoped_ptr<ParseNode> pRoot(Parser(code).parse(&status));
+    expect_true(status.getErrors().empty());
+    expect_true(pRoot->children().size() == 1);
+  }
+
+  test_that("serialized trees with malformed nodes are rejected")
+  {
+    std::string code = "x * y";
+    const std::vector<Token>& tokens = tokenize(code);
+    std::vector<parser::ParseError> errors;
+
+    // A binary operator missing an operand.
+    scoped_ptr<ParseNode> pRoot(ParseNode::create(tokens::ROOT));
+    ParseNode* pOperator = ParseNode::create(tokens[2]);
+    pOperator->append(ParseNode::create(tokens[0]));
+    pRoot->append(pOperator);
+
+    std::string buffer;
+    serialize::write(code.data(), utils::size(code), pRoot, errors, &buffer);
+    serialize::ParseTree tree;
+    expect_false(tree.read(buffer.data(), buffer.size()));
+
+    // The parser builds such nodes for code with errors, so those trees
+    // are read back.
+    errors.push_back(parser::ParseError("unexpected end of input"));
+    buffer.clear();
+    serialize::write(code.data(), utils::size(code), pRoot, errors, &buffer);
+    expect_true(tree.read(buffer.data(), buffer.size()));
+
+    // A symbol without a location.
+    pOperator->append(ParseNode::create(tokens::SYMBOL));
+    buffer.clear();
+    serialize::write(code.data(), utils::size(code), pRoot, errors, &buffer);
+    expect_false(tree.read(buffer.data(), buffer.size()));
+
+    // What the parser builds is read back, errors or not.
+    for (int seed = 0; seed < 100; ++seed)
+    {
+      std::string source = program(seed);
+      ParseStatus status;
+      scoped_ptr<ParseNode> pParsed(Parser(source).parse(&status));
+      buffer.clear();
+      serialize::write(source.data(), utils::size(source), pParsed, status.getErrors(), &buffer);
+      expect_true(tree.read(buffer.data(), buffer.size()));
+    }
+  }
+
+  test_that("programs can be parsed and diagnosed on many threads at once")
+  {
+    // Nothing is shared between threads but the inputs and the search
+    // path objects, which are only read; run under ThreadSanitizer, this
+    // should report no races.
+    std::vector<std::string> programs;
+    for (int i = 0; i < 2000; ++i)
+      programs.push_back(program(i));
+
+    r::SearchPathObjects objects;
+
+    index_type n = utils::size(programs);
+    std::vector<std::string> expected(n);
+    for (index_type i = 0; i < n; ++i)
+      expected[i] = summarize(programs[i], objects);
+
+    std::vector<std::string> actual(n);
+    std::vector<thread::Worker*> workers;
+    for (int i = 0; i < 8; ++i)
+      workers.push_back(new SummarizeWorker(programs, objects, &actual));
+
+    bool ok = thread::parallelFor(n, workers);
+
+    for (index_type i = 0; i < utils::size(workers); ++i)
+      delete workers[i];
+
+    expect_true(ok);
+    expect_true(actual == expected);
   }
 
 }
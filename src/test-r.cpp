@@ -22,6 +22,35 @@ private:
   std::set<std::string> strings_;
 };
 
+class NodeCounter : public r::CallRecurser::Operation
+{
+public:
+
+  explicit NodeCounter(int limit)
+    : count_(0), limit_(limit)
+  {
+  }
+
+  virtual void apply(SEXP dataSEXP)
+  {
+    ++count_;
+  }
+
+  virtual bool done() const
+  {
+    return count_ == limit_;
+  }
+
+  int count() const
+  {
+    return count_;
+  }
+
+private:
+  int count_;
+  int limit_;
+};
+
 context("CallRecurser")
 {
   test_that("The R call recurser works")
@@ -41,6 +70,22 @@ context("CallRecurser")
     expect_true(discoveries.count("all.equal"));
   }
 
+  test_that("The R call recurser stops once an operation is done")
+  {
+    SEXP fnSEXP = Rf_findFun(Rf_install("library"), R_BaseNamespace);
+
+    scoped_ptr<NodeCounter> all(new NodeCounter(-1));
+    scoped_ptr<NodeCounter> some(new NodeCounter(3));
+
+    r::CallRecurser recurser(fnSEXP);
+    recurser.add(all);
+    recurser.add(some);
+    recurser.run();
+
+    expect_true(all->count() == 3);
+    expect_true(some->count() == 3);
+  }
+
   test_that("Functions which perform non-standard evaluation are detected")
   {
     SEXP fnSEXP;
@@ -50,4 +95,33 @@ context("CallRecurser")
     fnSEXP = Rf_findFun(Rf_install(".gtn"), R_BaseNamespace);
     expect_false(r::nse::performsNonStandardEvaluation(fnSEXP));
   }
+
+  test_that("The non-standard evaluation database evicts the least recently used")
+  {
+    SEXP librarySEXP = Rf_findFun(Rf_install("library"), R_BaseNamespace);
+    SEXP gtnSEXP     = Rf_findFun(Rf_install(".gtn"), R_BaseNamespace);
+    SEXP pasteSEXP   = Rf_findFun(Rf_install("paste"), R_BaseNamespace);
+
+    r::nse::Database database(2);
+    expect_true(database.check(librarySEXP));
+    expect_false(database.check(gtnSEXP));
+    expect_true(database.check(librarySEXP));
+    expect_false(database.check(pasteSEXP));
+    expect_false(database.check(gtnSEXP));
+
+    const r::nse::Database::Statistics& statistics = database.statistics();
+    expect_true(database.size() == 2);
+    expect_true(statistics.hits == 1);
+    expect_true(statistics.misses == 4);
+    expect_true(statistics.evictions == 2);
+  }
+
+  test_that("The non-standard evaluation database clamps its capacity")
+  {
+    r::nse::Database database(1 << 30);
+    expect_true(database.capacity() == r::nse::Database::maxCapacity());
+
+    database.reset(-1);
+    expect_true(database.capacity() == 0);
+  }
 }